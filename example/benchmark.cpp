@@ -0,0 +1,421 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <new>
+#include <unistd.h>
+
+#include "Optimizer/Optimizer.h"
+#include "Optimizer/ParticleSwarmOptimization.h"
+#include "Optimizer/SwarmStore.h"
+#include "Optimizer/Affinity.h"
+
+
+/**
+ * 	Measures the overhead of the library rather than the quality of its
+ * 	solutions, so that changes to the scheduling can be compared between
+ * 	versions. For every cost model and thread count a PSO is run on a
+ * 	synthetic objective that spins for a given time, and the following
+ * 	is recorded:
+ *
+ * 	- evaluations per second and the speedup over one thread,
+ * 	- overhead per evaluation, i.e. worker time not spent in the objective,
+ * 	- generation latency percentiles,
+ * 	- time the optimizing thread spends in serial work between parallel phases,
+ * 	- heap allocations per generation, which should be zero after the first.
+ *
+ * 	The dispatch overhead is measured separately by repeatedly evaluating
+ * 	a block of no-op evaluations. For these, the fraction of the pages of
+ * 	each worker's share of the rows that is on the worker's own NUMA node
+ * 	is also recorded; the rest is read across sockets in every round.
+ *
+ * 	Results are written as JSON.
+ *
+ * 	Usage: benchmark [--threads N] [--costs noop,1us,10ms,heavy,<microseconds>]
+ * 	                 [--schedule static|dynamic|guided|adaptive]
+ * 	                 [--affinity none|compact|scatter]
+ * 	                 [--scale S] [--output benchmark.json] [--check-allocations]
+ *
+ * 	With --check-allocations the exit status is 1 if any generation but
+ * 	the first allocated memory.
+ */
+
+
+/** Number of calls of operator new in all threads */
+std::atomic<uint64_t> allocations(0);
+
+void* operator new( size_t size )
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if (p == 0)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete( void* p ) noexcept
+{
+	free(p);
+}
+
+
+/** Cost of one evaluation */
+class CostModel
+{
+public:
+	std::string name;
+	double seconds;		///< Cost of every evaluation, or minimum cost if heavy-tailed
+	bool heavyTailed;	///< Pareto distributed cost with shape 1.5, capped at 1000 times the minimum
+	unsigned particles;
+	unsigned generations;
+};
+
+class SyntheticWorker : public PAO::OptimizationWorker
+{
+public:
+	SyntheticWorker( const CostModel &cost ) : cost(cost), evaluations(0), costSeconds(0) {
+		PAO::ParameterBounds b;
+		for (int i=0; i<Dimensions; ++i)
+			b.registerParameter(-1, 1);
+		setParameterBounds(b);
+	}
+
+	double fitnessFunction (PAO::Parameters &X) {
+		double sum=0;
+		for (int i=0; i<Dimensions; ++i)
+			sum += X[i]*X[i];
+
+		double seconds = cost.seconds;
+		if (cost.heavyTailed) {
+			// Derive the cost from the point so that runs are repeatable
+			uint64_t bits;
+			memcpy(&bits, &X[0], sizeof(bits));
+			bits ^= bits >> 33;
+			bits *= 0xff51afd7ed558ccdULL;
+			bits ^= bits >> 33;
+			double u = ((bits >> 11) + 0.5) * (1.0/9007199254740992.0);
+			seconds = std::min(cost.seconds * pow(u, -1/1.5), 1000*cost.seconds);
+		}
+		if (seconds > 0) {
+			auto until = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+			while (std::chrono::steady_clock::now() < until)
+				;
+		}
+
+		++evaluations;
+		costSeconds += seconds;
+		return sum;
+	}
+
+	const CostModel &cost;
+	uint64_t evaluations;	///< Only touched by the worker's own thread
+	double costSeconds;
+
+private:
+	static const int Dimensions=8;
+};
+
+
+/** Evaluates a block of rows repeatedly to time the dispatching alone */
+class DispatchBenchmark : public PAO::MasterOptimizer
+{
+public:
+	DispatchBenchmark( std::vector<PAO::OptimizationWorker*> workers, unsigned items, unsigned rounds,
+			PAO::SchedulePolicy_t schedule, PAO::AffinityPolicy_t affinity )
+	: MasterOptimizer( workers ), items(items), rounds(rounds), localPages(0), pages(0)
+	{
+		setSchedulePolicy(schedule);
+		setAffinity(affinity);
+		store.resize(items, *paramBounds);
+		chunkSize = std::max(1u, items/(8*(unsigned)workers.size()));
+
+		// Every worker writes its own share first, as the PSO does
+		parallelFor(items, 1, [this](PAO::OptimizationWorker* worker, unsigned begin, unsigned end) {
+			for (unsigned i=begin; i<end; ++i) {
+				store.clearPadding(i);
+				for (unsigned j=0; j<store.dimensions(); ++j)
+					store.position(i)[j] = (i%97)/97.0;
+			}
+		}, PAO::StaticSchedule);
+	}
+
+	/** Returns seconds per evaluation */
+	double optimize() {
+		evaluate( store.positionData(), store.stride(), items, store.fitnessData() ); // Warm up
+
+		// Check where the pages of each worker's share are
+		parallelFor(items, 1, [this](PAO::OptimizationWorker* worker, unsigned begin, unsigned end) {
+			const size_t page = sysconf(_SC_PAGESIZE);
+			int node = PAO::currentNode();
+			uintptr_t first = (uintptr_t)store.position(begin) / page * page;
+			unsigned local = 0, count = 0;
+			for (uintptr_t address=first; address<(uintptr_t)store.position(end); address+=page, ++count)
+				if (PAO::nodeOfAddress((const void*)address) == node)
+					++local;
+			localPages += local;
+			pages += count;
+		}, PAO::StaticSchedule);
+
+		auto started = std::chrono::steady_clock::now();
+		for (unsigned round=0; round<rounds; ++round)
+			evaluate( store.positionData(), store.stride(), items, store.fitnessData() );
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+		return elapsed.count() / ((double)rounds*items);
+	}
+
+	/** Fraction of the pages of the rows that are on the node of the worker owning them */
+	double getLocalPageFraction() {return pages > 0 ? (double)localPages/pages : 0;};
+
+private:
+	PAO::SwarmStore store;
+	unsigned items;
+	unsigned rounds;
+	std::atomic<unsigned> localPages;
+	std::atomic<unsigned> pages;
+};
+
+
+/** Time of every generation callback during a run */
+std::vector<std::chrono::steady_clock::time_point> generationTimes;
+/** Allocations made before every generation callback */
+std::vector<uint64_t> generationAllocations;
+
+void recordGeneration( unsigned generation, double y )
+{
+	generationTimes.push_back( std::chrono::steady_clock::now() );
+	generationAllocations.push_back( allocations.load() );
+}
+
+double percentile( std::vector<double> values, double p )
+{
+	if (values.empty())
+		return 0;
+	std::sort(values.begin(), values.end());
+	size_t index = std::min(values.size()-1, (size_t)(p*(values.size()-1) + 0.5));
+	return values[index];
+}
+
+const char* scheduleNames[] = {"static", "dynamic", "guided", "adaptive"};
+const char* affinityNames[] = {"none", "compact", "scatter"};
+
+/** Parse a cost such as noop, 1us, 10ms, heavy or a number of microseconds */
+CostModel parseCost( const std::string &name, double scale )
+{
+	CostModel cost;
+	cost.name = name;
+	cost.heavyTailed = false;
+	if (name == "noop")
+		cost.seconds = 0;
+	else if (name == "heavy") {
+		cost.seconds = 10e-6;
+		cost.heavyTailed = true;
+	}
+	else if (name.size() > 2 && name.substr(name.size()-2) == "ms")
+		cost.seconds = atof(name.c_str())*1e-3;
+	else if (name.size() > 2 && name.substr(name.size()-2) == "us")
+		cost.seconds = atof(name.c_str())*1e-6;
+	else
+		cost.seconds = atof(name.c_str())*1e-6;
+
+	// Aim for about a second of evaluations per run on one thread
+	double mean = cost.heavyTailed ? 3*cost.seconds : cost.seconds;
+	double evaluations = std::max(100.0, std::min(2e6, 1.0/std::max(mean, 1e-7))) * scale;
+	cost.generations = evaluations >= 20000 ? 20 : 5;
+	cost.particles = std::max(8u, (unsigned)(evaluations/cost.generations));
+	return cost;
+}
+
+
+int main(int argc, char** argv)
+{
+	unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	std::string costList = "noop,1us,10ms,heavy";
+	std::string output = "benchmark.json";
+	double scale = 1;
+	PAO::SchedulePolicy_t schedule = PAO::AdaptiveSchedule;
+	PAO::AffinityPolicy_t affinity = PAO::NoAffinity;
+
+	bool checkAllocations = false;
+	for (int i=1; i<argc; ++i) {
+		std::string option = argv[i];
+		if (option == "--check-allocations") {
+			checkAllocations = true;
+			continue;
+		}
+		if (i+1 >= argc) {
+			std::cout << "Option "<<option<<" needs a value"<<std::endl;
+			return 1;
+		}
+		++i;
+		if (option == "--threads")
+			maxThreads = atoi(argv[i]);
+		else if (option == "--costs")
+			costList = argv[i];
+		else if (option == "--schedule") {
+			unsigned policy = 0;
+			while (policy < 4 && scheduleNames[policy] != std::string(argv[i]))
+				++policy;
+			if (policy == 4) {
+				std::cout << "Unknown schedule "<<argv[i]<<std::endl;
+				return 1;
+			}
+			schedule = (PAO::SchedulePolicy_t)policy;
+		}
+		else if (option == "--affinity") {
+			unsigned policy = 0;
+			while (policy < 3 && affinityNames[policy] != std::string(argv[i]))
+				++policy;
+			if (policy == 3) {
+				std::cout << "Unknown affinity "<<argv[i]<<std::endl;
+				return 1;
+			}
+			affinity = (PAO::AffinityPolicy_t)policy;
+		}
+		else if (option == "--scale")
+			scale = atof(argv[i]);
+		else if (option == "--output")
+			output = argv[i];
+		else {
+			std::cout << "Unknown option "<<option<<std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<CostModel> costs;
+	std::stringstream costStream(costList);
+	std::string name;
+	while (std::getline(costStream, name, ','))
+		costs.push_back( parseCost(name, scale) );
+
+	std::vector<unsigned> threadCounts;
+	for (unsigned threads=1; threads<maxThreads; threads*=2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(maxThreads);
+
+	std::ofstream json(output.c_str());
+	json << "{\n";
+	json << "  \"hardwareConcurrency\": "<<std::thread::hardware_concurrency()<<",\n";
+	json << "  \"velocityKernel\": \""<<PAO::getVelocityKernelName()<<"\",\n";
+	json << "  \"schedule\": \""<<scheduleNames[schedule]<<"\",\n";
+	json << "  \"affinity\": \""<<affinityNames[affinity]<<"\",\n";
+	json << "  \"numaNodes\": "<<PAO::CpuTopology().nodes.size()<<",\n";
+
+	// Dispatch overhead with no-op evaluations
+	CostModel noop = parseCost("noop", scale);
+	json << "  \"dispatch\": [\n";
+	for (unsigned t=0; t<threadCounts.size(); ++t) {
+		unsigned threads = threadCounts[t];
+		std::vector<PAO::OptimizationWorker*> workers =
+				PAO::createLocalWorkers<SyntheticWorker>(threads, affinity, std::vector<unsigned>(), noop);
+
+		double seconds, localPages;
+		{
+			DispatchBenchmark benchmark( workers, 10000, std::max(1u, (unsigned)(50*scale)), schedule, affinity );
+			seconds = benchmark.optimize();
+			localPages = benchmark.getLocalPageFraction();
+		}
+		for (unsigned i=0; i<threads; ++i)
+			delete workers[i];
+
+		json << "    {\"threads\": "<<threads<<", \"nsPerEvaluation\": "<<seconds*1e9
+			<< ", \"workerNsPerEvaluation\": "<<seconds*1e9*threads<<", \"localPageFraction\": "<<localPages<<"}"<<(t+1<threadCounts.size() ? "," : "")<<"\n";
+	}
+	json << "  ],\n";
+
+	// PSO runs
+	std::stringstream summary;
+	summary << "cost\tthreads\tevaluations/s\tspeedup\toverhead ns\tp50 ms\tp99 ms\tserial %\tallocations\n";
+	uint64_t steadyAllocations = 0;
+	json << "  \"runs\": [\n";
+	for (unsigned c=0; c<costs.size(); ++c) {
+		double single = 0;
+		for (unsigned t=0; t<threadCounts.size(); ++t) {
+			unsigned threads = threadCounts[t];
+			std::vector<PAO::OptimizationWorker*> workers =
+					PAO::createLocalWorkers<SyntheticWorker>(threads, affinity, std::vector<unsigned>(), costs[c]);
+			std::vector<SyntheticWorker*> synthetic;
+			for (unsigned i=0; i<threads; ++i)
+				synthetic.push_back( static_cast<SyntheticWorker*>(workers[i]) );
+
+			PAO::PSOParameters psoparams;
+			psoparams.swarms = 1;
+			psoparams.particleCount = costs[c].particles;
+			psoparams.generations = costs[c].generations;
+			psoparams.variant = PAO::NeighborhoodBest;
+
+			double wall, serial, utilization;
+			generationTimes.clear();
+			generationTimes.reserve(psoparams.generations);
+			generationAllocations.clear();
+			generationAllocations.reserve(psoparams.generations);
+			{
+				PAO::ParticleSwarmOptimizer pso( workers, psoparams );
+				pso.setSeed(1);
+				pso.setSchedulePolicy(schedule);
+				pso.setAffinity(affinity);
+				pso.setCallbackGeneration(recordGeneration);
+
+				auto started = std::chrono::steady_clock::now();
+				pso.optimize();
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+				wall = elapsed.count();
+				serial = wall - pso.getParallelTime();
+				utilization = pso.getUtilization();
+			}
+
+			uint64_t evaluations = 0;
+			double costSeconds = 0;
+			for (unsigned i=0; i<threads; ++i) {
+				evaluations += synthetic[i]->evaluations;
+				costSeconds += synthetic[i]->costSeconds;
+				delete synthetic[i];
+			}
+
+			// The first generation includes initialization of the swarm and is left out
+			std::vector<double> latencies;
+			uint64_t allocated = 0;
+			for (unsigned g=1; g<generationTimes.size(); ++g) {
+				latencies.push_back( std::chrono::duration<double>(generationTimes[g]-generationTimes[g-1]).count()*1e3 );
+				allocated += generationAllocations[g]-generationAllocations[g-1];
+			}
+			steadyAllocations += allocated;
+
+			double rate = evaluations/wall;
+			if (t == 0)
+				single = rate;
+			double overhead = (wall*threads - costSeconds)/evaluations*1e9;
+
+			json << "    {\"cost\": \""<<costs[c].name<<"\", \"threads\": "<<threads
+				<< ", \"particles\": "<<costs[c].particles<<", \"generations\": "<<costs[c].generations
+				<< ", \"evaluations\": "<<evaluations<<", \"seconds\": "<<wall
+				<< ", \"evaluationsPerSecond\": "<<rate<<", \"speedup\": "<<rate/single
+				<< ", \"overheadNsPerEvaluation\": "<<overhead<<", \"utilization\": "<<utilization
+				<< ", \"serialSeconds\": "<<serial<<", \"serialFraction\": "<<serial/wall
+				<< ", \"allocationsAfterFirstGeneration\": "<<allocated
+				<< ", \"generationLatencyMs\": {\"p50\": "<<percentile(latencies, 0.5)
+				<< ", \"p90\": "<<percentile(latencies, 0.9)<<", \"p99\": "<<percentile(latencies, 0.99)
+				<< ", \"max\": "<<percentile(latencies, 1)<<"}}"
+				<< (c+1<costs.size() || t+1<threadCounts.size() ? "," : "")<<"\n";
+
+			summary << costs[c].name<<"\t"<<threads<<"\t"<<rate<<"\t"<<rate/single<<"\t"<<overhead
+				<<"\t"<<percentile(latencies, 0.5)<<"\t"<<percentile(latencies, 0.99)<<"\t"<<serial/wall*100<<"\t"<<allocated<<"\n";
+		}
+	}
+	json << "  ]\n}\n";
+
+	std::cout << "\n" << summary.str();
+	std::cout << "Results written to "<<output<<std::endl;
+
+	if (checkAllocations && steadyAllocations > 0) {
+		std::cout << steadyAllocations<<" allocations after the first generation"<<std::endl;
+		return 1;
+	}
+
+	return 0;
+}
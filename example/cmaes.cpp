@@ -0,0 +1,71 @@
+
+
+#include <cmath>
+
+#include "Optimizer/Optimizer.h"
+#include "Optimizer/CMAESOptimization.h"
+
+
+// This example minimizes an ill-conditioned ellipsoid, where the
+// scale of the parameters differs by a factor of a thousand. Such
+// problems are where CMA-ES shines: it learns the shape of the
+// function and then converges as fast as on a sphere.
+
+class Ellipsoid : public PAO::OptimizationWorker
+{
+public:
+
+	Ellipsoid() {
+		PAO::ParameterBounds b;
+		for (int i=0; i<Dimensions; ++i)
+			b.registerParameter(-5, 5);
+
+		setParameterBounds(b);
+	}
+
+	// Rotating the axes by summing neighbouring parameters makes the
+	// problem non-separable, so it cannot be solved one parameter at a time.
+	double fitnessFunction (PAO::Parameters &X) {
+		double sum=0;
+		for (int i=0; i<Dimensions; ++i) {
+			double x = (i+1 < Dimensions) ? X[i] + X[i+1] - 1 : X[i] - 1;
+			sum += std::pow(1e6, i/(Dimensions-1.0)) * x*x;
+		}
+		return sum;
+	}
+
+private:
+	const int Dimensions=20;
+};
+
+
+int main()
+{
+	int numWorkers = std::thread::hardware_concurrency();
+
+	std::vector<PAO::OptimizationWorker*> workers;
+	for (int i=0; i<numWorkers; ++i)
+		workers.push_back( new Ellipsoid );
+
+	// The defaults suit most problems. Each restart doubles the
+	// population, which helps on functions with many local minima.
+	PAO::CMAESParameters cmaesparams;
+	cmaesparams.restarts = 4;
+
+	PAO::CMAESOptimizer CMAES( workers, cmaesparams );
+	CMAES.setCallbackNewMinimum(printNewMinimum);
+
+	// Stop as soon as the target is reached
+	PAO::StoppingCriteria criteria;
+	criteria.targetFitness = 1e-10;
+	CMAES.setStoppingCriteria(criteria);
+
+	double y = CMAES.optimize();
+
+	std::cout << "Best value found is "<<y<<" after "<<CMAES.getTotalStatistics().evaluations<<" evaluations"<<std::endl;
+
+	for (int i=0; i<numWorkers; ++i)
+		delete workers[i];
+
+	return 0;
+}
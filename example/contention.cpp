@@ -0,0 +1,100 @@
+
+#include <chrono>
+#include <cstdlib>
+
+#include "Optimizer/Optimizer.h"
+
+
+/**
+ * 	Measures how many evaluations per second the dispatcher manages
+ * 	to hand out when the fitness function is almost free. With such a
+ * 	cheap function the time is dominated by the scheduling of work, so
+ * 	the numbers show how well the dispatcher scales with thread count.
+ *
+ * 	Usage: contention [max threads] [items per round]
+ */
+
+
+class CheapWorker : public PAO::OptimizationWorker
+{
+public:
+	CheapWorker() {
+		PAO::ParameterBounds b;
+		for (int i=0; i<Dimensions; ++i)
+			b.registerParameter(-1, 1);
+		setParameterBounds(b);
+	}
+
+	double fitnessFunction (PAO::Parameters &X) {
+		double sum=0;
+		for (int i=0; i<Dimensions; ++i)
+			sum += X[i]*X[i];
+		return sum;
+	}
+
+private:
+	static const int Dimensions=4;
+};
+
+
+/** Repeatedly evaluates the same set of items, recording evaluations per second. */
+class ContentionBenchmark : public PAO::MasterOptimizer
+{
+public:
+	ContentionBenchmark( std::vector<PAO::OptimizationWorker*> workers, unsigned items, unsigned chunk )
+	: MasterOptimizer( workers ), data(items)
+	{
+		chunkSize = chunk;
+		for (unsigned i=0; i<items; ++i) {
+			data[i].parameters.assign(paramBounds->size(), i/(double)items);
+			indata.push_back( &data[i] );
+		}
+	}
+
+	/** Returns evaluations per second */
+	double optimize() {
+		const int Rounds = 50;
+		auto started = std::chrono::steady_clock::now();
+		for (int round=0; round<Rounds; ++round)
+			evaluate( &indata[0], indata.size() );
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+		return Rounds*indata.size() / elapsed.count();
+	}
+
+private:
+	std::vector<PAO::OptimizationData> data;
+	std::vector<PAO::OptimizationData*> indata;
+};
+
+
+int main(int argc, char** argv)
+{
+	unsigned maxThreads = argc>1 ? atoi(argv[1]) : 64;
+	unsigned items = argc>2 ? atoi(argv[2]) : 100000;
+
+	std::vector<unsigned> threadCounts;
+	std::vector<double> results;
+
+	for (unsigned threads=1; threads<=maxThreads; threads*=2) {
+		std::vector<PAO::OptimizationWorker*> workers;
+		for (unsigned i=0; i<threads; ++i)
+			workers.push_back( new CheapWorker );
+
+		double evaluationsPerSecond;
+		{
+			ContentionBenchmark benchmark( workers, items, 64 );
+			evaluationsPerSecond = benchmark.optimize();
+		}
+		threadCounts.push_back(threads);
+		results.push_back(evaluationsPerSecond);
+
+		for (unsigned i=0; i<threads; ++i)
+			delete workers[i];
+	}
+
+	std::cout << "\nthreads\tevaluations/s\tspeedup\n";
+	for (unsigned i=0; i<results.size(); ++i)
+		std::cout << threadCounts[i] << "\t" << results[i] << "\t" << results[i]/results[0] << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,94 @@
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+
+#include "Optimizer/Optimizer.h"
+#include "Optimizer/ParticleSwarmOptimization.h"
+#include "Optimizer/FixedParticleSwarmOptimization.h"
+
+
+// The Rosenbrock problem of example/rosenbrock.cpp, solved once with
+// ParticleSwarmOptimizer and once with FixedParticleSwarmOptimizer,
+// which knows the number of parameters at compile time. Both use the
+// same random streams, so for the same seed they must find the very
+// same solution as long as ParticleSwarmOptimizer does its velocity
+// update with the portable kernel. The example fails if they do not.
+
+const unsigned Dimensions = 3;
+
+class Rosenbrock : public PAO::OptimizationWorker
+{
+public:
+
+	Rosenbrock() {
+		PAO::ParameterBounds b;
+		for (unsigned i=0; i<Dimensions; ++i)
+			b.registerParameter(-L/2, L/2);
+
+		setParameterBounds(b);
+	}
+
+	double fitnessFunction (PAO::Parameters &X) {
+		double sum=0;
+		for (unsigned i=0; i+1<Dimensions; ++i)
+			sum += 100*pow( X[i+1] - X[i]*X[i], 2) + pow(X[i]-1, 2);
+
+		return sum;
+	}
+
+private:
+	const double L=100;
+};
+
+
+int main()
+{
+	// The SIMD kernels round differently from the portable one, so
+	// they have to be disabled before the first optimizer is created.
+	setenv("PAO_SCALAR_KERNEL", "1", 1);
+
+	int numWorkers = std::thread::hardware_concurrency();
+
+	// A worker runs in the thread of one optimizer, so each optimizer
+	// gets its own.
+	std::vector<PAO::OptimizationWorker*> workers, fixedWorkers;
+	for (int i=0; i<numWorkers; ++i) {
+		workers.push_back( new Rosenbrock );
+		fixedWorkers.push_back( new Rosenbrock );
+	}
+
+	PAO::PSOParameters psoparams;
+	psoparams.swarms = 3;
+	psoparams.particleCount = 1000;
+	psoparams.generations = 100;
+	psoparams.variant = PAO::NeighborhoodBest;
+
+	PAO::ParticleSwarmOptimizer PSO( workers, psoparams );
+	PSO.setSeed(42);
+	double y = PSO.optimize();
+
+	PAO::FixedParticleSwarmOptimizer<Dimensions> fixedPSO( fixedWorkers, psoparams );
+	fixedPSO.setSeed(42);
+	double fixedY = fixedPSO.optimize();
+
+	std::cout << "Best value found is "<<y<<" with ParticleSwarmOptimizer"<<std::endl;
+	std::cout << "Best value found is "<<fixedY<<" with FixedParticleSwarmOptimizer<"<<Dimensions<<">"<<std::endl;
+
+	bool same = (y == fixedY);
+	const PAO::Parameters &X = PSO.getBestParameters()->parameters;
+	const PAO::FixedParameters<Dimensions> &fixedX = fixedPSO.getFixedBestParameters().parameters;
+	for (unsigned i=0; i<Dimensions; ++i)
+		same = same && (X[i] == fixedX[i]);
+
+	for (int i=0; i<numWorkers; ++i) {
+		delete workers[i];
+		delete fixedWorkers[i];
+	}
+
+	if (!same) {
+		std::cout << "The optimizers found different solutions"<<std::endl;
+		return 1;
+	}
+
+	return 0;
+}
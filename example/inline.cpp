@@ -0,0 +1,45 @@
+#include <thread>
+
+#include "Optimizer/InlineParticleSwarmOptimization.h"
+
+
+// The Rosenbrock problem of example/rosenbrock.cpp, but with the
+// fitness-function given as a lambda instead of an OptimizationWorker.
+// The optimizer knows its type, so the compiler can inline it into the
+// loop that moves the particles, which for a cheap function like this
+// is faster than calling a virtual fitnessFunction for every point.
+
+int main()
+{
+	const unsigned Dimensions = 3;
+	const double L = 100;
+
+	auto rosenbrock = [](const double* X, unsigned dimensions) {
+		double sum=0;
+		for (unsigned i=0; i+1<dimensions; ++i) {
+			double a = X[i+1] - X[i]*X[i];
+			double b = X[i] - 1;
+			sum += 100*a*a + b*b;
+		}
+		return sum;
+	};
+
+	PAO::ParameterBounds bounds;
+	for (unsigned i=0; i<Dimensions; ++i)
+		bounds.registerParameter(-L/2, L/2);
+
+	PAO::PSOParameters psoparams;
+	psoparams.swarms = 3;
+	psoparams.particleCount = 1000;
+	psoparams.generations = 100;
+	psoparams.variant = PAO::NeighborhoodBest;
+
+	// Worker threads are created by the optimizer, one per core
+	PAO::Inline::ParticleSwarmOptimizer<decltype(rosenbrock)> PSO( rosenbrock, bounds, psoparams );
+	PSO.setCallbackNewMinimum(printNewMinimum);
+
+	double y = PSO.optimize();
+	std::cout << "Best value found is "<<y<<std::endl;
+
+	return 0;
+}
@@ -0,0 +1,51 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "Optimizer/Optimizer.h"
+#include "Optimizer/Remote.h"
+
+
+// A worker process for distributing the evaluations of a MasterOptimizer
+// over several machines. Replace Rosenbrock with your own worker, start
+// the master with a PAO::RemoteWorkerPool and then run
+//     pao_worker <master host> <port>
+// on every machine, once per core. See example/remote.cpp for the master.
+
+class Rosenbrock : public PAO::OptimizationWorker
+{
+public:
+	Rosenbrock() {
+		PAO::ParameterBounds b;
+		for (int i=0; i<Dimensions; ++i)
+			b.registerParameter(-L/2, L/2);
+		
+		setParameterBounds(b);
+	}
+	
+	double fitnessFunction (PAO::Parameters &X) {
+		double sum=0;
+		for (int i=0; i<Dimensions-1; ++i)
+			sum += 100*pow( X[i+1] - X[i]*X[i], 2) + pow(X[i]-1, 2);
+			
+		return sum;
+	}	
+
+private:
+	const int Dimensions=3; // Dimensions of search-space
+	const double L=100; // Length of dimension searched
+};
+
+
+int main( int argc, char** argv )
+{
+	if (argc < 3) {
+		std::cout << "Usage: "<<argv[0]<<" <master host> <port>"<<std::endl;
+		return 1;
+	}
+
+	Rosenbrock worker;
+	bool orderly = PAO::runRemoteWorker( worker, argv[1], atoi(argv[2]) );
+	
+	return orderly ? 0 : 1;
+}
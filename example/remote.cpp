@@ -0,0 +1,88 @@
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+
+#include "Optimizer/Optimizer.h"
+#include "Optimizer/ParticleSwarmOptimization.h"
+#include "Optimizer/Remote.h"
+
+
+// Minimizes the Rosenbrock function like example/rosenbrock.cpp, but
+// sends the evaluations to pao_worker processes connecting over TCP:
+//     remote <port> [local workers]
+//     pao_worker localhost <port>
+// For testing on one machine, local workers starts that many workers
+// in this process, connected through localhost like any other.
+
+class Rosenbrock : public PAO::OptimizationWorker
+{
+public:
+	Rosenbrock() {
+		PAO::ParameterBounds b;
+		for (int i=0; i<Dimensions; ++i)
+			b.registerParameter(-L/2, L/2);
+		
+		setParameterBounds(b);
+	}
+	
+	double fitnessFunction (PAO::Parameters &X) {
+		double sum=0;
+		for (int i=0; i<Dimensions-1; ++i)
+			sum += 100*pow( X[i+1] - X[i]*X[i], 2) + pow(X[i]-1, 2);
+			
+		return sum;
+	}	
+
+private:
+	const int Dimensions=3; // Dimensions of search-space
+	const double L=100; // Length of dimension searched
+};
+
+
+int main( int argc, char** argv )
+{
+	unsigned short port = argc > 1 ? atoi(argv[1]) : 0;
+	int localWorkers = argc > 2 ? atoi(argv[2]) : 0;
+	
+	// The pool listens for pao_worker processes. The RemoteWorkers 
+	// forward the candidates given to them by the optimizer to the pool.
+	Rosenbrock problem;
+	PAO::RemoteWorkerPool *pool = new PAO::RemoteWorkerPool( problem.getParameterBounds(), port );
+	std::cout << "Listening on port "<<pool->getPort()<<std::endl;
+	
+	std::vector<Rosenbrock*> localProblems;
+	std::vector<std::thread> local;
+	for (int i=0; i<localWorkers; ++i) {
+		localProblems.push_back( new Rosenbrock );
+		local.push_back( std::thread(PAO::runRemoteWorker, std::ref(*localProblems[i]), "localhost", pool->getPort()) );
+	}
+	
+	std::vector<PAO::OptimizationWorker*> workers;
+	for (int i=0; i<4; ++i)
+		workers.push_back( new PAO::RemoteWorker(*pool) );
+	
+	PAO::PSOParameters psoparams;
+	psoparams.swarms = 3;
+	psoparams.particleCount = 1000;
+	psoparams.generations = 100;
+	psoparams.variant = PAO::NeighborhoodBest;
+	
+	PAO::ParticleSwarmOptimizer *PSO = new PAO::ParticleSwarmOptimizer( workers, psoparams );
+	PSO->setCallbackNewMinimum(printNewMinimum);
+	double y = PSO->optimize();
+	std::cout << "Best value found is "<<y<<std::endl;
+	std::cout << pool->getResent()<<" batches were resent"<<std::endl;
+	delete PSO;
+
+	for (unsigned i=0; i<workers.size(); ++i)
+		delete workers[i];
+	
+	// Deleting the pool tells the workers to shut down
+	delete pool;
+	for (int i=0; i<localWorkers; ++i) {
+		local[i].join();
+		delete localProblems[i];
+	}
+	
+	return 0;
+}
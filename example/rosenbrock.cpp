@@ -1,5 +1,7 @@
 
 
+#include <cmath>
+
 #include "Optimizer/Optimizer.h"
 #include "Optimizer/ParticleSwarmOptimization.h"
 
@@ -26,10 +28,16 @@ public:
 	// PAO::OptimizationWorker requires the fitnessFunction method
 	// to be implemented. This function should implement our f(X) 
 	// and return the value of said function.
-	double fitnessFunction (PAO::Parameters &X) {
+	// The context tells from which value on f(X) is of no use to the
+	// optimizer. Every term of the sum is positive, so once the sum
+	// gets there we may stop and return it as a lower bound.
+	double fitnessFunction (PAO::Parameters &X, PAO::EvaluationContext &context) {
 		double sum=0;
-		for (int i=0; i<Dimensions-1; ++i)
+		for (int i=0; i<Dimensions-1; ++i) {
 			sum += 100*pow( X[i+1] - X[i]*X[i], 2) + pow(X[i]-1, 2);
+			if (sum >= context.cutoff)
+				return context.lowerBound(sum);
+		}
 			
 		return sum;
 	}	
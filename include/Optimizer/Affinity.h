@@ -0,0 +1,99 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef AFFINITY_H_
+#define AFFINITY_H_
+
+#include <vector>
+#include <thread>
+
+namespace PAO
+{
+	class OptimizationWorker;
+
+	/** Where worker threads are run, see MasterOptimizer::setAffinity() */
+	enum AffinityPolicy_t {
+		NoAffinity,			///< Threads may run on any cpu, the default
+		CompactAffinity,	///< Fill the cpus of one NUMA node before using the next
+		ScatterAffinity,	///< Spread consecutive workers round-robin over the NUMA nodes
+		ExplicitAffinity	///< Worker i runs on cpu number i of a given list
+	};
+
+	/** The cpus this process may run on, grouped by NUMA node.
+	 *  Read from /sys/devices/system/node, a machine without it is one node. */
+	class CpuTopology
+	{
+	public:
+		CpuTopology();
+
+		/** Cpu for each of workers threads, -1 where the thread is not pinned.
+		 *  Threads are assigned round-robin when there are more threads than cpus.
+		 *  \param cpus The list used by ExplicitAffinity */
+		std::vector<int> assign( AffinityPolicy_t policy, unsigned workers,
+				const std::vector<unsigned> &cpus=std::vector<unsigned>() ) const;
+
+		/** NUMA node of cpu, or -1 if unknown */
+		int nodeOfCpu( int cpu ) const;
+
+		std::vector< std::vector<unsigned> > nodes;	///< Usable cpus of each node in ascending order
+		std::vector<unsigned> allowed;				///< All usable cpus
+	};
+
+	/** Restrict the calling thread to cpu, or to all usable cpus if cpu is -1.
+	 *  \return false if the cpu could not be used. */
+	bool pinCurrentThread( int cpu );
+
+	/** NUMA node of the page holding address, or -1 if unknown.
+	 *  A page is placed when it is first written. */
+	int nodeOfAddress( const void* address );
+
+	/** NUMA node of the cpu the calling thread runs on */
+	int currentNode();
+
+	/** Construct count workers with new Worker(args...). Each is constructed
+	 *  from a thread pinned to the cpu that worker i gets from
+	 *  MasterOptimizer::setAffinity() with the same policy, so the worker and
+	 *  memory its constructor writes end up on the node where it will run.
+	 *  The caller owns the workers. */
+	template <class Worker, class... Args>
+	std::vector<OptimizationWorker*> createLocalWorkers( unsigned count, AffinityPolicy_t policy,
+			const std::vector<unsigned> &cpus, const Args&... args )
+	{
+		std::vector<int> assigned = CpuTopology().assign(policy, count, cpus);
+		std::vector<OptimizationWorker*> workers(count);
+		for (unsigned i=0; i<count; ++i) {
+			std::thread creator([&] {
+				pinCurrentThread(assigned[i]);
+				workers[i] = new Worker(args...);
+			});
+			creator.join();
+		}
+		return workers;
+	}
+}
+
+#endif /* AFFINITY_H_ */
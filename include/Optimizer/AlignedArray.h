@@ -0,0 +1,86 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef ALIGNEDARRAY_H_
+#define ALIGNEDARRAY_H_
+
+#include <cstdlib>
+#include <new>
+
+namespace PAO
+{
+	/** Alignment of AlignedArray, enough for the widest SIMD registers. */
+	const unsigned ArrayAlignment = 64;
+
+	/** Fixed-size array of plain data aligned to ArrayAlignment.
+	 *  Unlike std::vector, memory is not touched when allocated. */
+	template <class T>
+	class AlignedArray
+	{
+	public:
+		AlignedArray() : ptr(0), count(0) {};
+		explicit AlignedArray( unsigned size ) : ptr(0), count(0) {resize(size);};
+		~AlignedArray() {free(ptr);};
+
+		/** Reallocate to hold size elements. Contents are not preserved. */
+		void resize( unsigned size ) {
+			if (size == count)
+				return;
+			free(ptr);
+			ptr = 0;
+			count = 0;
+			if (size == 0)
+				return;
+			void* mem = 0;
+			if (posix_memalign(&mem, ArrayAlignment, size*sizeof(T)) != 0)
+				throw std::bad_alloc();
+			ptr = (T*) mem;
+			count = size;
+		};
+
+		/** Set all elements to value */
+		void fill( const T &value ) {
+			for (unsigned i=0; i<count; ++i)
+				ptr[i] = value;
+		};
+
+		unsigned size() const {return count;};
+		T* data() {return ptr;};
+		const T* data() const {return ptr;};
+		T& operator[]( unsigned i ) {return ptr[i];};
+		const T& operator[]( unsigned i ) const {return ptr[i];};
+
+	private:
+		AlignedArray( const AlignedArray& );
+		AlignedArray& operator=( const AlignedArray& );
+
+		T* ptr;
+		unsigned count;
+	};
+}
+
+#endif /* ALIGNEDARRAY_H_ */
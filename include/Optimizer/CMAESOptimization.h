@@ -0,0 +1,203 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef CMAESOPTIMIZATION_H_
+#define CMAESOPTIMIZATION_H_
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "Optimizer.h"
+#include "AlignedArray.h"
+
+namespace PAO
+{
+	/** Eigendecomposition of symmetric matrices on a background thread.
+	 *
+	 *  start() copies the matrix and returns at once, so the decomposition
+	 *  overlaps with whatever the caller does next, e.g. evaluating a
+	 *  generation. The matrix is reduced to tridiagonal form by Householder
+	 *  transformations and diagonalized by the implicit QL method.
+	 */
+	class SymmetricEigensolver
+	{
+	public:
+		SymmetricEigensolver();
+		/** Finishes the decomposition in progress */
+		~SymmetricEigensolver();
+
+		/** Decompose the n by n matrix a stored row by row, stride doubles apart.
+		 *  Waits for the previous decomposition first. */
+		void start( const double* a, unsigned n, unsigned stride );
+		/** Wait until the decomposition started last is done */
+		void wait();
+		/** True from start() until the results have been read with wait() */
+		bool isStarted() {return started;};
+
+		/** Eigenvalues of the last decomposition, valid after wait() */
+		const double* eigenvalues() {return values.data();};
+		/** Eigenvectors of the last decomposition, valid after wait(). Column j,
+		 *  stride doubles apart, is the eigenvector of eigenvalue j. */
+		const double* eigenvectors() {return vectors.data();};
+
+		/** Replace the symmetric n by n matrix v by its eigenvectors and set d to its eigenvalues.
+		 *  \param e Scratch of n doubles. */
+		static void decompose( double* v, unsigned n, unsigned stride, double* d, double* e );
+
+	private:
+		void run();
+
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::thread thread;
+		AlignedArray<double> vectors;	///< Matrix being decomposed, then its eigenvectors
+		std::vector<double> values;
+		std::vector<double> offDiagonal;
+		unsigned n;
+		unsigned stride;
+		bool started;
+		bool pending;	///< Started but not yet picked up by the thread
+		bool busy;
+		bool stop;
+	};
+
+	/** Class specifying behaviour of CMAESOptimizer. */
+	class CMAESParameters
+	{
+	public:
+		CMAESParameters()
+		:		population(0),
+				sigma(0.3),
+				generations(0),
+				restarts(9),
+				populationIncrease(2),
+				tolFun(1e-12),
+				tolX(1e-12),
+				maxCondition(1e14)
+		{}
+
+		unsigned population;	///< Candidates per generation of the first run, 0 for 4+3ln(dimensions)
+		double sigma;			///< Initial step size as a fraction of each parameter's range
+		unsigned generations;	///< Generations of each run at most, 0 for 100+150(dimensions+3)^2/sqrt(population)
+		unsigned restarts;		///< Runs started anew after the first one has converged
+		double populationIncrease;	///< Factor the population grows by at each restart
+		double tolFun;			///< A run has converged when its best fitness-values of recent
+								///< generations and of all current candidates are this close
+		double tolX;			///< A run has converged when its step size is below this
+								///< fraction of the range in every direction
+		double maxCondition;	///< A run has converged when the condition number of its covariance matrix exceeds this
+	};
+
+	/** Implements the Covariance Matrix Adaptation Evolution Strategy with
+	 *  restarts of increasing population size (IPOP-CMA-ES).
+	 *
+	 *  Each generation samples population candidates from a normal
+	 *  distribution and moves it towards the best half of them, learning a
+	 *  covariance matrix that makes ill-conditioned and non-separable
+	 *  problems look like a sphere. Parameters are scaled to [0,1] by their
+	 *  bounds and candidates outside them are moved onto the bounds.
+	 *
+	 *  Candidates are sampled and evaluated in parallel on the workers, and
+	 *  the covariance matrix is updated on them in blocks of rows. Its
+	 *  eigendecomposition runs on a SymmetricEigensolver while the next
+	 *  generation is evaluated, so candidates are always sampled from the
+	 *  decomposition of the previous generation's matrix. The same seed
+	 *  gives the same search regardless of the number of workers.
+	 */
+	class CMAESOptimizer : public MasterOptimizer
+	{
+	public:
+		/** Constructor for CMAESOptimizer.
+		 * \param workers The workers used in parallell during optimization.
+		 * \param parameters Contains CMA-ES-specific parameters. */
+		CMAESOptimizer( std::vector<OptimizationWorker*> workers, CMAESParameters parameters );
+		virtual ~CMAESOptimizer();
+
+		double optimize();
+
+		/** Number of restarts made by the last optimize() */
+		unsigned getRestarts() {return restart;};
+
+	private:
+		/** Set the population, weights and learning rates and reset the distribution for a new run */
+		void startRun( unsigned population );
+		/** Run generations until the run converges.
+		 *  \return false if the optimization should stop. */
+		bool runGenerations();
+		/** Sample candidates [begin,end) of the current generation */
+		void sampleCandidates( OptimizationWorker* worker, unsigned begin, unsigned end );
+		/** Update rows [begin,end) of the covariance matrix from the selected steps */
+		void updateCovariance( OptimizationWorker* worker, unsigned begin, unsigned end );
+		/** Take the eigendecomposition of the covariance matrix from the eigensolver */
+		void adoptDecomposition();
+		/** True if the current run has converged or the fitness is flat */
+		bool hasConverged();
+
+		double* candidate( unsigned k ) {return candidates.data() + (size_t)k*stride;};
+		double* step( unsigned k ) {return steps.data() + (size_t)k*stride;};
+
+		CMAESParameters cmaes;
+
+		unsigned n;			///< Dimensions
+		unsigned stride;	///< Doubles between rows of all matrices
+		unsigned lambda;	///< Population of the current run
+		unsigned mu;		///< Candidates selected per generation
+		std::vector<double> weights;
+		double mueff, cc, cs, c1, cmu, damps, chiN;
+		double covarianceDecay;	///< Factor of the old covariance matrix in the current update
+		unsigned decompositionInterval;	///< Generations between eigendecompositions
+
+		// Distribution of the current run, in coordinates scaled to [0,1]
+		std::vector<double> mean;
+		double sigma;
+		std::vector<double> pc;		///< Evolution path of the covariance matrix
+		std::vector<double> ps;		///< Evolution path of the step size
+		AlignedArray<double> C;		///< Covariance matrix
+		AlignedArray<double> B;		///< Eigenvectors of C in columns
+		std::vector<double> D;		///< Square roots of the eigenvalues of C
+
+		AlignedArray<double> candidates;	///< lambda rows in parameter units, as evaluated
+		AlignedArray<double> steps;			///< lambda rows of (x-mean)/sigma in scaled coordinates
+		std::vector<double> fitness;
+		std::vector<unsigned> order;		///< Candidates from best to worst
+		AlignedArray<double> selected;		///< mu rows of the best steps, each times sqrt(cmu*weight)
+		AlignedArray<double> scratch;		///< A row per worker
+		std::vector<double> meanStep;		///< Weighted mean of the selected steps
+		std::vector<double> whitened;		///< C^-1/2 times meanStep
+		std::vector<double> history;		///< Best fitness-value of recent generations
+
+		SymmetricEigensolver eigensolver;
+		unsigned lastDecomposition;	///< Generation the last decomposition was started after
+		unsigned generation;		///< Of the current run
+		unsigned generations;		///< Of the whole optimization
+		unsigned restart;
+	};
+}
+
+#endif /* CMAESOPTIMIZATION_H_ */
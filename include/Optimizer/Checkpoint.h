@@ -0,0 +1,99 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstddef>
+
+namespace PAO
+{
+	/** Writes checkpoint files from a background thread.
+	 *
+	 *  The optimizer fills buffer() with a snapshot of its state and calls
+	 *  commit(), which returns at once. The thread writes the snapshot to a
+	 *  temporary file, syncs it and renames it over the checkpoint, so the
+	 *  checkpoint file is always complete even if the process is killed.
+	 *  If a snapshot is committed while an older one still waits to be
+	 *  written, the older one is skipped.
+	 */
+	class CheckpointWriter
+	{
+	public:
+		CheckpointWriter();
+		/** Finishes the pending write */
+		~CheckpointWriter();
+
+		/** Buffer for the next snapshot, reused between snapshots */
+		std::vector<char>& buffer() {return filling;};
+		/** Write the contents of buffer() to filename in the background */
+		void commit( const std::string &filename );
+		/** Wait until all committed snapshots are written */
+		void wait();
+
+	private:
+		void run();
+
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::thread thread;
+		std::vector<char> filling;	///< Being filled by the optimizer
+		std::vector<char> pending;	///< Committed, waiting for the thread
+		std::vector<char> writing;	///< Being written by the thread
+		std::string pendingFile;
+		bool hasPending;
+		bool busy;
+		bool stop;
+	};
+
+	/** Read-only memory mapping of a whole file */
+	class MappedFile
+	{
+	public:
+		/** Map filename, check isOpen() for success */
+		MappedFile( const std::string &filename );
+		~MappedFile();
+
+		bool isOpen() {return data != 0;};
+		const char* begin() {return data;};
+		size_t size() {return length;};
+
+	private:
+		MappedFile( const MappedFile& );
+		MappedFile& operator=( const MappedFile& );
+
+		const char* data;
+		size_t length;
+	};
+}
+
+#endif /* CHECKPOINT_H_ */
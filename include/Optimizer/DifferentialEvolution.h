@@ -0,0 +1,153 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef DIFFERENTIALEVOLUTION_H_
+#define DIFFERENTIALEVOLUTION_H_
+
+#include "Optimizer.h"
+#include "AlignedArray.h"
+
+namespace PAO
+{
+
+	enum DEVariant_t {
+		RandOneBinomial,	///< DE/rand/1/bin with fixed F and CR
+		CurrentToPBest		///< DE/current-to-pbest/1/bin with an archive and F and CR adapted as in JADE
+	};
+
+	/** Class specifying behaviour of DifferentialEvolutionOptimizer. */
+	class DEParameters
+	{
+	public:
+		DEParameters()
+		:		variant(CurrentToPBest),
+				populationSize(100),
+				generations(1000),
+				F(0.5),
+				CR(0.9),
+				p(0.05),
+				c(0.1)
+		{}
+
+		DEVariant_t variant;		///< Which mutation and parameter control to use
+		unsigned populationSize;	///< Number of individuals, at least 4
+		unsigned generations;		///< Number of generations to perform
+		double F;					///< Scale of difference vectors, the starting mean with CurrentToPBest
+		double CR;					///< Crossover probability, the starting mean with CurrentToPBest
+		double p;					///< CurrentToPBest moves towards one of the best p*populationSize individuals
+		double c;					///< Rate at which CurrentToPBest adapts the means of F and CR
+	};
+
+	/** Implements Differential Evolution, where each individual competes
+	 *  with a trial vector made by adding scaled differences of other
+	 *  individuals to it.
+	 *
+	 *  A generation makes all trial vectors in parallel from the population
+	 *  as it was before the generation, each individual drawing from its
+	 *  own random stream, and evaluates them on the workers with the
+	 *  fitness-value of their parent as cutoff. Selection then runs in
+	 *  parallel in blocks of individuals: a trial only ever replaces its
+	 *  own parent, so every row has a single writer and needs no lock.
+	 *  Each block also ranks its best individuals, so that the master
+	 *  only merges the few candidates for the best p*populationSize.
+	 *  Success statistics of CurrentToPBest are summed per block and the
+	 *  blocks merged in order, so the same seed gives the same search
+	 *  regardless of the number of workers.
+	 */
+	class DifferentialEvolutionOptimizer : public MasterOptimizer
+	{
+	public:
+		/** Constructor for DifferentialEvolutionOptimizer.
+		 * \param workers The workers used in parallell during optimization.
+		 * \param parameters Contains DE-specific parameters. */
+		DifferentialEvolutionOptimizer( std::vector<OptimizationWorker*> workers, DEParameters parameters );
+		virtual ~DifferentialEvolutionOptimizer();
+
+		double optimize();
+
+		/** Current mean of F of CurrentToPBest */
+		double getMeanF() {return meanF;};
+		/** Current mean of CR of CurrentToPBest */
+		double getMeanCR() {return meanCR;};
+
+	private:
+		/** Outcome of the selection of a block of SelectionBlock individuals */
+		class BlockResult
+		{
+		public:
+			double sumF;		///< Of successful trials
+			double sumF2;		///< Of squares of F of successful trials
+			double sumCR;		///< Of successful trials
+			unsigned successes;
+			unsigned ranked;	///< Individuals of the block in blockTop
+			char padding[2*CacheLineSize - 3*sizeof(double) - 2*sizeof(unsigned)];
+		};
+
+		/** Set up random individuals [begin,end) */
+		void initializeIndividuals( OptimizationWorker* worker, unsigned begin, unsigned end );
+		/** Make the trial vectors of individuals [begin,end) */
+		void createTrials( OptimizationWorker* worker, unsigned begin, unsigned end );
+		/** Replace parents by better trials in blocks [begin,end) and rank them */
+		void selectBlocks( OptimizationWorker* worker, unsigned begin, unsigned end );
+		/** Record the best topCount individuals of block k in blockTop, best first */
+		void rankBlock( unsigned k );
+		/** Merge the BlockResults, update the means of F and CR and bestParameters,
+		 *  and put the best pbestCount individuals first in ranking */
+		void mergeBlocks( double progress );
+
+		double* individual( unsigned i ) {return population.data() + (size_t)i*stride;};
+		double* trial( unsigned i ) {return trials.data() + (size_t)i*stride;};
+		double* archived( unsigned i ) {return archive.data() + (size_t)i*stride;};
+
+		DEParameters de;
+
+		unsigned n;			///< Dimensions
+		unsigned stride;	///< Doubles between rows
+		unsigned size;		///< Individuals
+		unsigned generation;
+
+		AlignedArray<double> population;
+		std::vector<double> fitness;
+		AlignedArray<double> trials;
+		std::vector<double> trialFitness;
+		std::vector<double> trialF;		///< F used by each trial
+		std::vector<double> trialCR;	///< CR used by each trial
+		/** Row i holds the parent last replaced by a trial of individual i,
+		 *  so that each archive row has the same single writer as its individual */
+		AlignedArray<double> archive;
+		std::vector<unsigned char> archiveValid;
+		std::vector<unsigned> ranking;	///< Best individuals of all blocks, the best pbestCount first
+		unsigned pbestCount;
+		std::vector<BlockResult> blocks;
+		std::vector<unsigned> blockTop;	///< topCount per block
+		unsigned topCount;				///< Individuals ranked per block, enough to find the best pbestCount
+		double meanF;
+		double meanCR;
+	};
+}
+
+#endif /* DIFFERENTIALEVOLUTION_H_ */
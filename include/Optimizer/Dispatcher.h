@@ -0,0 +1,206 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef DISPATCHER_H_
+#define DISPATCHER_H_
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <cstdint>
+
+namespace PAO
+{
+	class OptimizationWorker;
+	class WorkerCounters;
+
+	/** Assumed size of a cache line, used for padding shared counters. */
+	const unsigned CacheLineSize = 64;
+
+	/** Half-open range [begin,end) of item indices handed to a worker. */
+	class WorkRange
+	{
+	public:
+		unsigned begin;
+		unsigned end;
+
+		unsigned size() const {return end-begin;};
+	};
+
+	/** How the items of a job are divided into chunks */
+	enum SchedulePolicy_t {
+		StaticSchedule,		///< Every worker processes its own equal share in one chunk, no stealing
+		DynamicSchedule,	///< Chunks of a fixed size, idle workers steal
+		GuidedSchedule,		///< A worker takes half of what remains of its range, down to the chunk size
+		AdaptiveSchedule	///< Guided, with the smallest chunk chosen from the measured cost per item
+	};
+
+	/** Function processing the items [begin,end) of a job.
+	 *  Called from the thread of worker. */
+	typedef std::function<void(OptimizationWorker* worker, unsigned begin, unsigned end)> JobFunction;
+
+	/** Function called by a worker that found no items left while other
+	 *  workers are still processing theirs. Returns false when it has
+	 *  nothing to do, true to be called again. */
+	typedef std::function<bool(OptimizationWorker* worker)> IdleFunction;
+
+	/** Hands out the items of a job to the worker threads.
+	 *
+	 *  A job is a number of items identified only by their index. When a
+	 *  job is started the index range is split evenly over the workers, and
+	 *  every worker owns a range from which it pops chunks at the front.
+	 *  A worker that runs out of items steals half of the remaining range
+	 *  of another worker from the back. Each range is a single 64-bit word
+	 *  updated with compare-and-swap, so fetching work takes no lock and
+	 *  allocates nothing.
+	 *
+	 *  How large chunks are popped is decided by the SchedulePolicy_t of
+	 *  the job. Guided chunks start large to keep the dispatch overhead low
+	 *  and shrink towards the end so that workers finish together. The
+	 *  adaptive policy times the items of its jobs and picks the smallest
+	 *  chunk so that fetching takes about a percent of the time spent on
+	 *  items, which is as small as chunks can be made without the dispatch
+	 *  overhead showing.
+	 *
+	 *  A job run as interruptible stops handing out chunks once interrupt()
+	 *  is called or a deadline passes. The chunks already fetched are
+	 *  finished and run() returns with the rest of the items unprocessed.
+	 *
+	 *  The mutex is only used for sleeping between jobs.
+	 */
+	class Dispatcher
+	{
+	public:
+		Dispatcher();
+		~Dispatcher();
+
+		/** Set the number of worker threads. Must be called before any job is run. */
+		void setWorkerCount( unsigned workers );
+		unsigned getWorkerCount() {return workerCount;};
+
+		/** Process items [0,items) with job on the worker threads and
+		 *  block until all of them have been processed.
+		 *  \param chunkSize Number of items a worker grabs at a time,
+		 *  or the smallest number for guided and adaptive policies.
+		 *  \param interruptible If true the job stops early when interrupted,
+		 *  leaving items unprocessed.
+		 *  \param idle Called by workers waiting for the last items, or 0. */
+		void run( unsigned items, unsigned chunkSize, const JobFunction& job,
+				SchedulePolicy_t policy=DynamicSchedule, bool interruptible=false,
+				const IdleFunction* idle=0 );
+
+		/** Stop handing out items of the current and all later interruptible
+		 *  jobs until clearInterrupt() is called. Workers finish the chunk
+		 *  they hold. May be called from any thread. */
+		void interrupt();
+		void clearInterrupt() {interrupted = false;};
+		bool isInterrupted() {return interrupted;};
+
+		/** Interrupt when deadline has passed. Checked before every chunk.
+		 *  Must not be called while a job is running. */
+		void setDeadline( std::chrono::steady_clock::time_point deadline );
+		void clearDeadline() {hasDeadline = false;};
+
+		/** Block until a new job is started or stop is set.
+		 *  \param seenEpoch Job counter of caller, updated when a new job is found.
+		 *  \return false if the worker should exit. */
+		bool waitForJob( unsigned &seenEpoch, const std::atomic<bool> &stop );
+
+		/** Process items of the current job until no items remain.
+		 *  Must follow a successful waitForJob(). */
+		void work( unsigned workerIndex, OptimizationWorker* worker );
+
+		/** Wake all threads blocked in waitForJob() so that they can check their stop-flag. */
+		void wakeAll();
+
+		/** Counters of the worker with index workerIndex */
+		WorkerCounters& getCounters( unsigned workerIndex );
+
+		/** Measured seconds per item of jobs run with AdaptiveSchedule, or 0 before the first */
+		double getItemSeconds() {return itemSeconds;};
+
+	private:
+		/** Range owned by a worker, packed as (end<<32 | begin).
+		 *  Padded so that ranges of different workers never share a cache line. */
+		class Slot
+		{
+		public:
+			std::atomic<uint64_t> range;
+			char padding[2*CacheLineSize - sizeof(std::atomic<uint64_t>)];
+		};
+
+		static uint64_t pack( unsigned begin, unsigned end ) {return ((uint64_t)end<<32) | begin;};
+		static unsigned rangeBegin( uint64_t range ) {return (unsigned)range;};
+		static unsigned rangeEnd( uint64_t range ) {return (unsigned)(range>>32);};
+
+		/** Pop a chunk from the front of the range owned by workerIndex */
+		bool popOwn( unsigned workerIndex, WorkRange &range );
+		/** Move the back half of victim's range to thief */
+		bool steal( unsigned victim, unsigned thief );
+		/** Fetch next chunk for workerIndex, stealing if needed */
+		bool fetch( unsigned workerIndex, WorkRange &range, bool &stolen );
+		/** True if the current job is interruptible and has been interrupted,
+		 *  setting interrupted if the deadline has passed */
+		bool stopped();
+
+		std::unique_ptr<Slot[]> slots;
+		std::unique_ptr<WorkerCounters[]> counters;
+		unsigned workerCount;
+
+		/** Smallest chunk of an adaptive job of items items */
+		unsigned adaptiveChunkSize( unsigned items, unsigned chunkSize );
+
+		const JobFunction* job;
+		const IdleFunction* idle;
+		SchedulePolicy_t policy;
+		unsigned chunkSize;
+		std::atomic<unsigned> remaining; ///< Items not yet processed in current job
+		bool interruptible;	///< Current job stops when interrupted
+		std::atomic<bool> interrupted;
+		bool hasDeadline;
+		std::chrono::steady_clock::time_point deadline;
+
+		// Cost estimates of adaptive jobs, guarded by mutex
+		double itemSeconds;		///< Moving average of the time per item
+		double fetchSeconds;	///< Moving average of the time to fetch a chunk
+		uint64_t jobItems;		///< Items processed in the current job
+		uint64_t jobNanoseconds;	///< Time spent on them
+		uint64_t jobFetches;	///< Chunks fetched in the current job
+		uint64_t fetchNanoseconds;	///< Time spent fetching them
+
+		std::mutex mutex;
+		std::condition_variable jobReady;
+		std::condition_variable jobDone;
+		unsigned epoch;	///< Incremented for every started job
+		unsigned busy;	///< Workers currently inside work()
+	};
+}
+
+#endif /* DISPATCHER_H_ */
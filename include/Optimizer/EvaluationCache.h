@@ -0,0 +1,135 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef EVALUATIONCACHE_H_
+#define EVALUATIONCACHE_H_
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+namespace PAO
+{
+	class ParameterBounds;
+
+	/** Outcome of EvaluationCache::acquire */
+	enum CacheLookup_t {
+		CacheHit,		///< Fitness-value was found
+		CacheReserved,	///< Not found, caller must evaluate and call release()
+		CacheBusy		///< Another thread is evaluating the cell, only when not waiting
+	};
+
+	/** Concurrent cache of fitness-values for expensive fitness-functions.
+	 *
+	 *  Points are quantized to a grid with spacing relativeTolerance*(max-min)
+	 *  in each dimension, and points in the same cell share a fitness-value.
+	 *  The cache is split in shards with a lock and an LRU list each.
+	 *
+	 *  A thread that misses reserves the cell and must later call release().
+	 *  Other threads asking for the same cell meanwhile wait for that result
+	 *  instead of evaluating the point again.
+	 */
+	class EvaluationCache
+	{
+	public:
+		/** Quantized point */
+		typedef std::vector<int64_t> Key;
+
+		/** \param relativeTolerance Cell size as a fraction of each parameter's range.
+		 *  \param maxEntries Cache size, least recently used entries are dropped beyond it. */
+		EvaluationCache( ParameterBounds &bounds, double relativeTolerance, unsigned maxEntries, unsigned shards=64 );
+		~EvaluationCache();
+
+		/** Quantize the dimensions() first values of x */
+		void makeKey( const double* x, Key &key );
+
+		/** Look up key and set fitness on a hit. On a miss the cell is
+		 *  reserved for the caller. If another thread is evaluating the same
+		 *  cell, wait for its result or, if wait is false, return CacheBusy.
+		 *  A caller still holding reservations must not wait, or two threads
+		 *  may end up waiting for each other. */
+		CacheLookup_t acquire( const Key &key, double &fitness, bool wait=true );
+
+		/** Store the result of a missed key and wake threads waiting for it */
+		void release( const Key &key, double fitness );
+		/** Give up a reservation without storing a result, e.g. for a result that should not be reused */
+		void abandon( const Key &key );
+
+		unsigned dimensions() {return tolerance.size();};
+		/** Number of lookups answered from the cache */
+		uint64_t getHits() {return hits;};
+		/** Number of lookups that needed an evaluation */
+		uint64_t getMisses() {return misses;};
+		/** Number of hits that waited for an evaluation in progress */
+		uint64_t getCollapsed() {return collapsed;};
+
+	private:
+		class KeyHash
+		{
+		public:
+			size_t operator()( const Key &key ) const;
+		};
+
+		class Entry
+		{
+		public:
+			Key key;
+			double fitness;
+			bool pending;
+		};
+
+		class Shard
+		{
+		public:
+			std::mutex mutex;
+			std::condition_variable ready;
+			std::list<Entry> lru;	///< Most recently used first
+			std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> entries;
+		};
+
+		Shard& shardOf( const Key &key ) {return shards[KeyHash()(key) % shardCount];};
+		/** Drop least recently used entries of shard that are not pending */
+		void evict( Shard &shard );
+
+		std::vector<double> origin;
+		std::vector<double> tolerance;
+		unsigned shardCount;
+		unsigned entriesPerShard;
+		std::unique_ptr<Shard[]> shards;
+
+		std::atomic<uint64_t> hits;
+		std::atomic<uint64_t> misses;
+		std::atomic<uint64_t> collapsed;
+	};
+}
+
+#endif /* EVALUATIONCACHE_H_ */
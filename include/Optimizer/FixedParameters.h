@@ -0,0 +1,78 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef FIXEDPARAMETERS_H_
+#define FIXEDPARAMETERS_H_
+
+#include <array>
+
+#include "Optimizer.h"
+#include "AlignedArray.h"
+
+namespace PAO
+{
+	/** Parameter set with a dimension N known at compile time.
+	 *
+	 *  The values are stored inside the object, so copying a
+	 *  FixedParameters never touches the heap and loops over it have a
+	 *  constant trip count. The storage is padded with zeros to a whole
+	 *  number of ArrayAlignment blocks, so an AlignedArray of
+	 *  FixedParameters is a row-major array with Stride doubles per row
+	 *  where every row is aligned, the same layout as SwarmStore uses.
+	 */
+	template <unsigned N>
+	class FixedParameters
+	{
+	public:
+		/** Doubles per object, N rounded up to a multiple of ArrayAlignment */
+		static const unsigned Stride = (N*sizeof(double) + ArrayAlignment-1)/ArrayAlignment*ArrayAlignment/sizeof(double);
+
+		static unsigned size() {return N;};
+		double* data() {return values.data();};
+		const double* data() const {return values.data();};
+		double& operator[]( unsigned i ) {return values[i];};
+		const double& operator[]( unsigned i ) const {return values[i];};
+
+		/** Set all values, including the padding, to zero */
+		void clear() {values.fill(0);};
+		/** Copy the N values to parameters */
+		void copyTo( Parameters &parameters ) const {parameters.assign(values.begin(), values.begin()+N);};
+
+		std::array<double, Stride> values;
+	};
+
+	/** Parameters of fixed dimension and their corresponding fitness-value */
+	template <unsigned N>
+	class FixedOptimizationData
+	{
+	public:
+		FixedParameters<N> parameters;
+		double fitnessValue;
+	};
+}
+
+#endif /* FIXEDPARAMETERS_H_ */
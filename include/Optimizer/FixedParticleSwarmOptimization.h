@@ -0,0 +1,331 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef FIXEDPARTICLESWARMOPTIMIZATION_H_
+#define FIXEDPARTICLESWARMOPTIMIZATION_H_
+
+#include <iostream>
+#include <limits>
+#include <cstdlib>
+
+#include "ParticleSwarmOptimization.h"
+#include "FixedParameters.h"
+
+namespace PAO
+{
+	/** ParticleSwarmOptimizer for a number of parameters N known at compile time.
+	 *
+	 *  Particles are held in AlignedArrays of FixedParameters<N>, so the
+	 *  velocity update is a loop of constant length that the compiler
+	 *  unrolls and vectorizes, and copying positions and bests never
+	 *  allocates. Nothing is allocated in the generation loop after the
+	 *  first generation.
+	 *
+	 *  Runs synchronous update of sequential swarms with the same random
+	 *  streams as ParticleSwarmOptimizer, so both find the same solution
+	 *  for the same seed when ParticleSwarmOptimizer uses the scalar
+	 *  velocity kernel. Asynchronous update, islands, checkpoints, the
+	 *  surrogate and refinement need ParticleSwarmOptimizer.
+	 */
+	template <unsigned N>
+	class FixedParticleSwarmOptimizer : public MasterOptimizer
+	{
+	public:
+		/** \param workers Their parameter bounds must have N parameters. */
+		FixedParticleSwarmOptimizer( std::vector<OptimizationWorker*> workers, PSOParameters parameters );
+
+		double optimize();
+
+		/** Returns the best solution found so far, also available through getBestParameters() */
+		const FixedOptimizationData<N>& getFixedBestParameters() {return best;};
+
+	private:
+		typedef FixedParameters<N> Row;
+
+		/** Best particle found by one worker during updateBests() */
+		class PartialBest
+		{
+		public:
+			double fitness;
+			unsigned index;
+			char padding[2*CacheLineSize - sizeof(double) - sizeof(unsigned)];
+		};
+
+		/** Allocate the swarm and set up random starting positions */
+		void initializeSwarm();
+		/** Set up random starting positions for particles [begin,end) */
+		void initializeParticles( unsigned begin, unsigned end );
+		void runSynchronous();
+		unsigned findNeighborhoodBest( unsigned i );
+		/** Move particle i towards its personal best and l */
+		void moveParticle( unsigned i, const Row &l, unsigned substream );
+		void updateParticles( unsigned begin, unsigned end );
+		void updateBests( OptimizationWorker* worker, unsigned begin, unsigned end );
+		void updateBestParameters( double progress );
+
+		PSOParameters pso;
+
+		AlignedArray<Row> positions;
+		AlignedArray<Row> bests;
+		AlignedArray<Row> velocities;
+		AlignedArray<double> fitness;
+		AlignedArray<double> bestFitness;
+		Row lower;
+		Row upper;
+
+		Row swarmBest;
+		double swarmBestFitness;
+		std::vector<PartialBest> partialBests;	///< One per worker
+		FixedOptimizationData<N> best;
+
+		double inertia;
+		unsigned swarm;
+		unsigned generation;
+	};
+}
+
+
+template <unsigned N>
+PAO::FixedParticleSwarmOptimizer<N>::FixedParticleSwarmOptimizer(
+		std::vector<OptimizationWorker*> workers, PSOParameters parameters )
+ : MasterOptimizer( workers )
+{
+	pso = parameters;
+	if (paramBounds->size() != (int)N) {
+		std::cout << "\e[0;31mERROR: FixedParticleSwarmOptimizer<"<<N<<"> given "<<paramBounds->size()<<" parameters\e[0m"<<std::endl;
+		abort();
+	}
+
+	lower.clear();
+	upper.clear();
+	for (unsigned j=0; j<N; ++j) {
+		lower[j] = paramBounds->min[j];
+		upper[j] = paramBounds->max[j];
+	}
+	best.fitnessValue = std::numeric_limits<double>::max();
+	inertia = 0.95;
+	swarm = 0;
+	generation = 0;
+}
+
+template <unsigned N>
+double PAO::FixedParticleSwarmOptimizer<N>::optimize()
+{
+	std::cout << "Optimizing " << N << " dimensions with fixed-size parameters"<<std::endl;
+	std::cout << "Starting PSO with "<<pso.swarms<<" swarms with "<<pso.particleCount<<" particles in each and "<<pso.generations<<" generations.\n";
+	std::cout << "Using "<<(pso.variant==NeighborhoodBest ? "neighborhood" : "population")<<" best variant\n";
+	std::cout << "Using PSO:c1="<<pso.c1<<", PSO:c2="<<pso.c2<<std::endl;
+	if (pso.update != SynchronousUpdate || pso.swarmMode != SequentialSwarms || pso.checkpointInterval > 0 || pso.surrogateFraction > 0 || pso.refineCount > 0)
+		std::cout << "\e[0;33mWarning: FixedParticleSwarmOptimizer only runs sequential swarms with synchronous update and without checkpoints, surrogate or refinement\e[0m"<<std::endl;
+	std::cout << "Using seed "<<seed<<std::endl;
+
+	best.fitnessValue = std::numeric_limits<double>::max();
+	bestParameters.fitnessValue = std::numeric_limits<double>::max();
+	partialBests.resize(workers.size());
+	resetUtilization();
+	resetStopping();
+
+	for (swarm=0; swarm<pso.swarms && !isStopping(); ++swarm) {
+		std::cout << "Initiating swarm "<<swarm+1<< " of "<<pso.swarms<<std::endl;
+		initializeSwarm();
+		runSynchronous();
+	}
+
+	if (isStopping())
+		std::cout << "Stopped early: "<<getStopReasonName(stopReason)<<std::endl;
+	std::cout << "Worker utilization: "<<getUtilization()*100<<"%"<<std::endl;
+	return best.fitnessValue;
+}
+
+template <unsigned N>
+void PAO::FixedParticleSwarmOptimizer<N>::initializeSwarm()
+{
+	unsigned particles = pso.particleCount;
+	inertia = 0.95;
+	positions.resize(particles);
+	bests.resize(particles);
+	velocities.resize(particles);
+	fitness.resize(particles);
+	bestFitness.resize(particles);
+
+	// First touch of every worker's share from that worker, see SwarmStore
+	parallelFor(particles, 1, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+		initializeParticles(begin, end); }, StaticSchedule);
+
+	swarmBest = positions[particles-1];
+	swarmBestFitness = std::numeric_limits<double>::max();
+	generation = 0;
+}
+
+template <unsigned N>
+void PAO::FixedParticleSwarmOptimizer<N>::initializeParticles( unsigned begin, unsigned end )
+{
+	for (unsigned i=begin; i<end; ++i) {
+		// Same streams as ParticleSwarmOptimizer::initializeParticles
+		RandomStream random(seed, ((uint64_t)swarm<<32) | i, 0);
+		positions[i].clear();
+		velocities[i].clear();
+		for (unsigned j=0; j<N; ++j) {
+			double min = lower[j];
+			double max = upper[j];
+			positions[i][j] = random.uniform(min, max);
+			velocities[i][j] = random.uniform()/100 * (max-min)+min;
+		}
+		bests[i] = positions[i];
+		fitness[i] = std::numeric_limits<double>::max();
+		bestFitness[i] = fitness[i];
+	}
+}
+
+template <unsigned N>
+void PAO::FixedParticleSwarmOptimizer<N>::runSynchronous()
+{
+	unsigned particles = pso.particleCount;
+	unsigned threads = workers.size();
+	unsigned partition = std::max(1u, particles/(4*threads));
+
+	for (; generation<pso.generations; ++generation) {
+		parallelFor(particles, partition, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+			updateParticles(begin, end); });
+
+		evaluate( positions[0].data(), Row::Stride, particles, fitness.data(), bestFitness.data() );
+
+		for (unsigned i=0; i<partialBests.size(); ++i) {
+			partialBests[i].fitness = std::numeric_limits<double>::max();
+			partialBests[i].index = particles;
+		}
+		parallelFor(particles, partition, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+			updateBests(worker, begin, end); });
+
+		// Ties go to the lowest index so the result does not depend on the partitioning
+		PartialBest* winner = &partialBests[0];
+		for (unsigned i=1; i<threads; ++i) {
+			if ( partialBests[i].fitness < winner->fitness ||
+					(partialBests[i].fitness == winner->fitness && partialBests[i].index < winner->index) )
+				winner = &partialBests[i];
+		}
+		if ( winner->fitness < swarmBestFitness ) {
+			swarmBest = positions[winner->index];
+			swarmBestFitness = winner->fitness;
+		}
+		updateBestParameters( (swarm*pso.generations + generation)/((double)pso.generations * pso.swarms) );
+
+		if (callbackGeneration != 0)
+			callbackGeneration(swarm*pso.generations + generation+1, best.fitnessValue);
+
+		double spread = wantsDiversity() ? diversity(bests[0].data(), Row::Stride, particles) : -1;
+		if (checkGeneration(swarm*pso.generations + generation+1, best.fitnessValue, spread))
+			break;
+	}
+}
+
+template <unsigned N>
+unsigned PAO::FixedParticleSwarmOptimizer<N>::findNeighborhoodBest( unsigned i )
+{
+	unsigned n = pso.particleCount;
+	unsigned prev = (i-1+n)%n;
+	unsigned next = (i+1)%n;
+	unsigned result = i;
+	if ( bestFitness[next] < bestFitness[result] )
+		result = next;
+	if ( bestFitness[prev] < bestFitness[result] )
+		result = prev;
+	return result;
+}
+
+template <unsigned N>
+void PAO::FixedParticleSwarmOptimizer<N>::moveParticle( unsigned i, const Row &l, unsigned substream )
+{
+	Row r1, r2;
+	RandomStream stream(seed, ((uint64_t)swarm<<32) | i, substream);
+	stream.fill(r1.data(), N);
+	stream.fill(r2.data(), N);
+	for (unsigned j=N; j<Row::Stride; ++j) {
+		r1[j] = 0;
+		r2[j] = 0;
+	}
+
+	// Padding lanes are zero in all rows and stay zero
+	double* x = positions[i].data();
+	double* v = velocities[i].data();
+	const double* p = bests[i].data();
+	const double c1 = pso.c1, c2 = pso.c2, w = inertia;
+	for (unsigned j=0; j<Row::Stride; ++j) {
+		v[j] = v[j]*w + c1*r1[j]*(p[j]-x[j]) + c2*r2[j]*(l[j]-x[j]);
+
+		double newPos = x[j] + v[j];
+		if (newPos < lower[j])
+			newPos = lower[j];
+		if (newPos > upper[j])
+			newPos = upper[j];
+		x[j] = newPos;
+	}
+}
+
+template <unsigned N>
+void PAO::FixedParticleSwarmOptimizer<N>::updateParticles( unsigned begin, unsigned end )
+{
+	for (unsigned i=begin; i<end; ++i) {
+		// Personal bests are not changed during this pass
+		if (pso.variant == NeighborhoodBest)
+			moveParticle(i, bests[findNeighborhoodBest(i)], generation+1);
+		else
+			moveParticle(i, swarmBest, generation+1);
+	}
+}
+
+template <unsigned N>
+void PAO::FixedParticleSwarmOptimizer<N>::updateBests( OptimizationWorker* worker, unsigned begin, unsigned end )
+{
+	PartialBest &partial = partialBests[worker->getIndex()];
+
+	for (unsigned i=begin; i<end; ++i) {
+		if (fitness[i] < bestFitness[i]) {
+			bests[i] = positions[i];
+			bestFitness[i] = fitness[i];
+		}
+		if ( fitness[i] < partial.fitness || (fitness[i] == partial.fitness && i < partial.index) ) {
+			partial.fitness = fitness[i];
+			partial.index = i;
+		}
+	}
+}
+
+template <unsigned N>
+void PAO::FixedParticleSwarmOptimizer<N>::updateBestParameters( double progress )
+{
+	if (swarmBestFitness < best.fitnessValue) {
+		best.parameters = swarmBest;
+		best.fitnessValue = swarmBestFitness;
+		best.parameters.copyTo(bestParameters.parameters);
+		bestParameters.fitnessValue = swarmBestFitness;
+		if (callbackFoundNewMinimum!=0)
+			callbackFoundNewMinimum(best.fitnessValue, progress);
+	}
+}
+
+#endif /* FIXEDPARTICLESWARMOPTIMIZATION_H_ */
@@ -0,0 +1,354 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef INLINEPARTICLESWARMOPTIMIZATION_H_
+#define INLINEPARTICLESWARMOPTIMIZATION_H_
+
+#include <iostream>
+#include <limits>
+#include <cstring>
+#include <thread>
+
+#include "ParticleSwarmOptimization.h"
+#include "SwarmStore.h"
+#include "WorkerCounters.h"
+
+namespace PAO
+{
+	/** Optimizers taking the fitness-function as a template parameter */
+	namespace Inline
+	{
+		/** Worker thread holding its own copy of the objective.
+		 *  fitnessFunction forwards to it, so the MasterOptimizer's own
+		 *  evaluation paths work as well. */
+		template <class Objective>
+		class ObjectiveWorker : public OptimizationWorker
+		{
+		public:
+			ObjectiveWorker( const Objective &objective, const ParameterBounds &bounds )
+			 : objective(objective) {setParameterBounds(bounds);};
+
+			double fitnessFunction( Parameters &parameters ) {
+				return objective(parameters.data(), parameters.size()); };
+
+			Objective objective;
+		};
+
+		/** Owns the workers of an optimizer. Inherited before MasterOptimizer
+		 *  so that the workers are created before and deleted after it. */
+		template <class Objective>
+		class ObjectiveWorkers
+		{
+		protected:
+			ObjectiveWorkers( const Objective &objective, const ParameterBounds &bounds, unsigned threads ) {
+				if (threads == 0)
+					threads = std::max(1u, std::thread::hardware_concurrency());
+				for (unsigned i=0; i<threads; ++i)
+					objectiveWorkers.push_back( new ObjectiveWorker<Objective>(objective, bounds) );
+			};
+			~ObjectiveWorkers() {
+				for (unsigned i=0; i<objectiveWorkers.size(); ++i)
+					delete objectiveWorkers[i];
+			};
+
+			std::vector<OptimizationWorker*> objectiveWorkers;
+		};
+
+		/** Particle swarm optimizer calling a functor or lambda instead of a
+		 *  virtual fitnessFunction.
+		 *
+		 *  The objective is called as objective(const double* x, unsigned dimensions)
+		 *  and its value is minimized. Every worker thread gets a copy of it.
+		 *  Since its type is known here, the compiler can inline it into the
+		 *  loop that moves a particle and evaluates it right away, which for
+		 *  cheap analytic objectives costs less than a virtual call per point.
+		 *
+		 *  The work is run on the library's Dispatcher and follows
+		 *  setSchedulePolicy(). Runs synchronous update of sequential swarms
+		 *  with the same random streams as PAO::ParticleSwarmOptimizer, and
+		 *  gives the same result when that uses the scalar velocity kernel.
+		 *  The EvaluationCache is not used.
+		 *
+		 *  Example:
+		 *
+		 *  	auto sphere = [](const double* x, unsigned n) {double s=0; for (unsigned j=0; j<n; ++j) s+=x[j]*x[j]; return s;};
+		 *  	PAO::Inline::ParticleSwarmOptimizer<decltype(sphere)> pso(sphere, bounds, psoparams);
+		 *  	pso.optimize();
+		 */
+		template <class Objective>
+		class ParticleSwarmOptimizer : private ObjectiveWorkers<Objective>, public MasterOptimizer
+		{
+		public:
+			/** \param threads Number of worker threads, 0 for one per core */
+			ParticleSwarmOptimizer( const Objective &objective, const ParameterBounds &bounds,
+					PSOParameters parameters, unsigned threads=0 );
+
+			double optimize();
+
+		private:
+			typedef ObjectiveWorker<Objective> Worker;
+
+			/** Best particle found by one worker during updateBests() */
+			class PartialBest
+			{
+			public:
+				double fitness;
+				unsigned index;
+				char padding[2*CacheLineSize - sizeof(double) - sizeof(unsigned)];
+			};
+
+			void initializeSwarm();
+			void initializeParticles( unsigned begin, unsigned end );
+			void runSynchronous();
+			unsigned findNeighborhoodBest( unsigned i );
+			/** Move particles [begin,end) and evaluate them with the objective of worker */
+			void moveAndEvaluate( Worker* worker, unsigned begin, unsigned end );
+			void updateBests( OptimizationWorker* worker, unsigned begin, unsigned end );
+			void updateBestParameters( double progress );
+
+			PSOParameters pso;
+			SwarmStore store;
+			AlignedArray<double> swarmBest;
+			double swarmBestFitness;
+			AlignedArray<double> randomNumbers;		///< Two rows of scratch per worker
+			std::vector<PartialBest> partialBests;	///< One per worker
+
+			double inertia;
+			unsigned swarm;
+			unsigned generation;
+		};
+	}
+}
+
+
+template <class Objective>
+PAO::Inline::ParticleSwarmOptimizer<Objective>::ParticleSwarmOptimizer( const Objective &objective,
+		const ParameterBounds &bounds, PSOParameters parameters, unsigned threads )
+ : ObjectiveWorkers<Objective>( objective, bounds, threads ),
+   MasterOptimizer( this->objectiveWorkers )
+{
+	pso = parameters;
+	swarmBestFitness = std::numeric_limits<double>::max();
+	inertia = 0.95;
+	swarm = 0;
+	generation = 0;
+}
+
+template <class Objective>
+double PAO::Inline::ParticleSwarmOptimizer<Objective>::optimize()
+{
+	std::cout << "Optimizing " << paramBounds->size() << " dimensions with an inlined objective"<<std::endl;
+	std::cout << "Starting PSO with "<<pso.swarms<<" swarms with "<<pso.particleCount<<" particles in each and "<<pso.generations<<" generations.\n";
+	std::cout << "Using "<<(pso.variant==NeighborhoodBest ? "neighborhood" : "population")<<" best variant\n";
+	std::cout << "Using PSO:c1="<<pso.c1<<", PSO:c2="<<pso.c2<<std::endl;
+	if (pso.update != SynchronousUpdate || pso.swarmMode != SequentialSwarms || pso.checkpointInterval > 0 || pso.surrogateFraction > 0 || pso.refineCount > 0)
+		std::cout << "\e[0;33mWarning: Inline::ParticleSwarmOptimizer only runs sequential swarms with synchronous update and without checkpoints, surrogate or refinement\e[0m"<<std::endl;
+	std::cout << "Using seed "<<seed<<std::endl;
+
+	bestParameters.fitnessValue = std::numeric_limits<double>::max();
+	partialBests.resize(workers.size());
+	resetUtilization();
+	resetStopping();
+
+	for (swarm=0; swarm<pso.swarms && !isStopping(); ++swarm) {
+		std::cout << "Initiating swarm "<<swarm+1<< " of "<<pso.swarms<<std::endl;
+		initializeSwarm();
+		runSynchronous();
+	}
+
+	if (isStopping())
+		std::cout << "Stopped early: "<<getStopReasonName(stopReason)<<std::endl;
+	std::cout << "Worker utilization: "<<getUtilization()*100<<"%"<<std::endl;
+	return bestParameters.fitnessValue;
+}
+
+template <class Objective>
+void PAO::Inline::ParticleSwarmOptimizer<Objective>::initializeSwarm()
+{
+	unsigned threads = workers.size();
+	inertia = 0.95;
+	store.resize(pso.particleCount, *paramBounds);
+	swarmBest.resize(store.stride());
+	randomNumbers.resize(2*store.stride()*threads);
+
+	// First touch of every worker's share from that worker, see SwarmStore
+	parallelFor(store.size(), 1, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+		initializeParticles(begin, end); }, StaticSchedule);
+
+	memcpy(swarmBest.data(), store.position(store.size()-1), store.stride()*sizeof(double));
+	swarmBestFitness = std::numeric_limits<double>::max();
+	generation = 0;
+}
+
+template <class Objective>
+void PAO::Inline::ParticleSwarmOptimizer<Objective>::initializeParticles( unsigned begin, unsigned end )
+{
+	unsigned params = store.dimensions();
+	for (unsigned i=begin; i<end; ++i) {
+		// Same streams as PAO::ParticleSwarmOptimizer::initializeParticles
+		RandomStream random(seed, ((uint64_t)swarm<<32) | i, 0);
+		for (unsigned param=0; param<params; ++param) {
+			double min = store.lower()[param];
+			double max = store.upper()[param];
+			store.position(i)[param] = random.uniform(min, max);
+			store.velocity(i)[param] = random.uniform()/100 * (max-min)+min;
+		}
+		store.clearPadding(i);
+		store.fitness(i) = std::numeric_limits<double>::max();
+		memcpy(store.best(i), store.position(i), store.stride()*sizeof(double));
+		store.bestFitness(i) = store.fitness(i);
+	}
+}
+
+template <class Objective>
+void PAO::Inline::ParticleSwarmOptimizer<Objective>::runSynchronous()
+{
+	unsigned threads = workers.size();
+	unsigned partition = std::max(1u, store.size()/(4*threads));
+
+	for (; generation<pso.generations; ++generation) {
+		parallelFor(store.size(), chunkSize, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+			moveAndEvaluate(static_cast<Worker*>(worker), begin, end); }, schedule);
+
+		for (unsigned i=0; i<partialBests.size(); ++i) {
+			partialBests[i].fitness = std::numeric_limits<double>::max();
+			partialBests[i].index = store.size();
+		}
+		parallelFor(store.size(), partition, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+			updateBests(worker, begin, end); });
+
+		// Ties go to the lowest index so the result does not depend on the partitioning
+		PartialBest* winner = &partialBests[0];
+		for (unsigned i=1; i<threads; ++i) {
+			if ( partialBests[i].fitness < winner->fitness ||
+					(partialBests[i].fitness == winner->fitness && partialBests[i].index < winner->index) )
+				winner = &partialBests[i];
+		}
+		if ( winner->fitness < swarmBestFitness ) {
+			memcpy(swarmBest.data(), store.position(winner->index), store.stride()*sizeof(double));
+			swarmBestFitness = winner->fitness;
+		}
+		updateBestParameters( (swarm*pso.generations + generation)/((double)pso.generations * pso.swarms) );
+
+		if (callbackGeneration != 0)
+			callbackGeneration(swarm*pso.generations + generation+1, bestParameters.fitnessValue);
+
+		double spread = wantsDiversity() ? diversity(store.best(0), store.stride(), store.size()) : -1;
+		if (checkGeneration(swarm*pso.generations + generation+1, bestParameters.fitnessValue, spread))
+			break;
+	}
+}
+
+template <class Objective>
+unsigned PAO::Inline::ParticleSwarmOptimizer<Objective>::findNeighborhoodBest( unsigned i )
+{
+	unsigned n = store.size();
+	unsigned prev = (i-1+n)%n;
+	unsigned next = (i+1)%n;
+	unsigned result = i;
+	if ( store.bestFitness(next) < store.bestFitness(result) )
+		result = next;
+	if ( store.bestFitness(prev) < store.bestFitness(result) )
+		result = prev;
+	return result;
+}
+
+template <class Objective>
+void PAO::Inline::ParticleSwarmOptimizer<Objective>::moveAndEvaluate( Worker* worker, unsigned begin, unsigned end )
+{
+	auto started = WorkerCounters::Clock::now();
+	const unsigned stride = store.stride();
+	const unsigned params = store.dimensions();
+	const double* lower = store.lower();
+	const double* upper = store.upper();
+	const double c1 = pso.c1, c2 = pso.c2, w = inertia;
+	double* r1 = randomNumbers.data() + 2*stride*worker->getIndex();
+	double* r2 = r1 + stride;
+	for (unsigned j=params; j<stride; ++j) {
+		r1[j] = 0;
+		r2[j] = 0;
+	}
+
+	for (unsigned i=begin; i<end; ++i) {
+		// Personal bests are not changed during this pass
+		const double* l = swarmBest.data();
+		if (pso.variant == NeighborhoodBest)
+			l = store.best(findNeighborhoodBest(i));
+
+		RandomStream stream(seed, ((uint64_t)swarm<<32) | i, generation+1);
+		stream.fill(r1, params);
+		stream.fill(r2, params);
+
+		// Padding lanes are zero in all rows and stay zero
+		double* x = store.position(i);
+		double* v = store.velocity(i);
+		const double* p = store.best(i);
+		for (unsigned j=0; j<stride; ++j) {
+			v[j] = v[j]*w + c1*r1[j]*(p[j]-x[j]) + c2*r2[j]*(l[j]-x[j]);
+
+			double newPos = x[j] + v[j];
+			if (newPos < lower[j])
+				newPos = lower[j];
+			if (newPos > upper[j])
+				newPos = upper[j];
+			x[j] = newPos;
+		}
+
+		store.fitness(i) = worker->objective(x, params);
+	}
+	dispatcher.getCounters(worker->getIndex()).addEvaluations(end-begin, WorkerCounters::since(started));
+}
+
+template <class Objective>
+void PAO::Inline::ParticleSwarmOptimizer<Objective>::updateBests( OptimizationWorker* worker, unsigned begin, unsigned end )
+{
+	PartialBest &partial = partialBests[worker->getIndex()];
+
+	for (unsigned i=begin; i<end; ++i) {
+		if (store.fitness(i) < store.bestFitness(i)) {
+			memcpy(store.best(i), store.position(i), store.stride()*sizeof(double));
+			store.bestFitness(i) = store.fitness(i);
+		}
+		if ( store.fitness(i) < partial.fitness || (store.fitness(i) == partial.fitness && i < partial.index) ) {
+			partial.fitness = store.fitness(i);
+			partial.index = i;
+		}
+	}
+}
+
+template <class Objective>
+void PAO::Inline::ParticleSwarmOptimizer<Objective>::updateBestParameters( double progress )
+{
+	if (swarmBestFitness < bestParameters.fitnessValue) {
+		bestParameters.parameters.assign(swarmBest.data(), swarmBest.data()+store.dimensions());
+		bestParameters.fitnessValue = swarmBestFitness;
+		if (callbackFoundNewMinimum!=0)
+			callbackFoundNewMinimum(bestParameters.fitnessValue, progress);
+	}
+}
+
+#endif /* INLINEPARTICLESWARMOPTIMIZATION_H_ */
@@ -11,8 +11,8 @@ good solutions to a multi-dimensional problem where exhaustive search
 is infeasible due to the large search-space.
 
 It is implemented using *C++11* and its native multithreading capabilities.
-My plan is to also implement *MPI* which would make this library
-far more useful for computer clusters.
+Evaluations can also be distributed over the machines of a cluster through
+a small TCP protocol. My plan is to also implement *MPI*.
 
 The library is evolving and the API should not be considered final in any way yet. However, I have been using this library for my own application since early 2012 and I am so far confident in the library's function.
 
@@ -29,6 +29,117 @@ and call its MasterOptimizer.optimize() to start the search for a solution.
 
 When done, retrieve best solution with MasterOptimizer.getBestParameters().
 
+If your fitness-function is cheaper per point when given many points at once,
+override OptimizationWorker.fitnessFunctionBatch and declare the preferred
+number of points with OptimizationWorker.setBatchSize.
+
+If your fitness-function is expensive and the search revisits nearly the same
+points, MasterOptimizer.enableEvaluationCache reuses earlier results for points
+within a tolerance of each other.
+
+If your fitness-function is not thread-safe or may crash, wrap one worker per
+thread in a ProcessWorker, which evaluates in a child process that is
+restarted when it dies.
+
+To spread evaluations over several machines, give the optimizer RemoteWorkers
+sharing a RemoteWorkerPool and run a pao_worker process per core on each
+machine, see example/remote.cpp and example/pao_worker.cpp.
+
+Long PSO runs can be checkpointed by setting PSOParameters.checkpointInterval,
+and continued after an interruption with ParticleSwarmOptimizer.resume.
+
+To see where the workers spend their time, MasterOptimizer.getWorkerStatistics
+returns per-worker counts of evaluations, chunks and steals, an evaluation
+latency histogram, and time spent fetching work, waiting for locks and idling.
+It can be called from another thread while optimizing.
+
+Evaluations are handed to the workers in chunks sized from the measured cost
+of an evaluation. MasterOptimizer.setSchedulePolicy selects static, dynamic or
+guided chunks instead.
+
+When the number of parameters is known at compile time, the header-only
+FixedParticleSwarmOptimizer<N> keeps particles in FixedParameters<N> rows
+and runs the generation loop with loops of constant length and no heap
+allocations.
+
+For cheap fitness-functions, PAO::Inline::ParticleSwarmOptimizer takes the
+function as a functor or lambda template parameter instead of a virtual
+fitnessFunction, so that it can be inlined into the particle update, see
+example/inline.cpp.
+
+On machines with several NUMA nodes, MasterOptimizer.setAffinity pins the
+worker threads compactly, scattered over the nodes or to a list of cpus.
+Particles are then placed on the node of the worker that uses them, and
+createLocalWorkers constructs each worker on its own node.
+
+optimize() runs all generations of all swarms unless it is told when to
+stop earlier. setStoppingCriteria() takes a target fitness-value, a number
+of generations without improvement, a smallest diversity of the personal
+bests, a cap on evaluations and a time limit, and setCallbackStop() adds a
+test of your own. requestStop() stops a run from another thread. Once a
+criterion is met no new evaluations are handed out, those in progress are
+finished and the best solution found is returned. getStopReason() tells
+which criterion ended the run.
+
+A fitness-function that may hang on some parameters can be given up on
+with MasterOptimizer.setEvaluationTimeout, which assigns a penalty to
+points that take too long. Long fitness-functions should poll
+OptimizationWorker.shouldStop and return early when it is true, and a
+ProcessWorker kills a child that runs over the timeout. setSpeculation
+lets workers that are out of work evaluate the last slow points of a
+generation again, using whichever result comes first.
+
+Objectives that sum many terms, like the Rosenbrock example, can override
+fitnessFunction(Parameters&, EvaluationContext&) instead. The context
+holds a cutoff, the particle's personal best, from which the value is of
+no use to the optimizer. Once a partial sum reaches it the function may
+return it through EvaluationContext.lowerBound. Lower bounds are not
+cached and never become bests, so the search is the same as without
+cutoffs.
+
+For fitness-functions that take seconds, PSOParameters.surrogateFraction lets
+a SurrogateModel pre-screen the particles of synchronous update. The model is
+a k-nearest-neighbour regression over the evaluated points, kept in a ring
+of surrogateCapacity points so it grows by copying instead of refitting, and
+all particles are predicted in parallel. Points whose fitness-function stopped at
+the cutoff are left out, as they only returned a lower bound. Only the particles with the best
+predictions on each island are evaluated; the others get their prediction,
+which never counts as a new personal best. Until the model holds
+surrogateNeighbors points every particle is evaluated. The saved evaluations
+are reported after the run and by getSurrogateSavings(). Checkpoints do not
+include the model, so a resumed run evaluates all particles of its first
+generation again and continues differently.
+
+CMAESOptimizer is an alternative to the PSO for smooth problems, in particular
+ill-conditioned and non-separable ones, where it usually needs far fewer
+evaluations. It implements CMA-ES with IPOP restarts: when a run converges,
+a new one starts with CMAESParameters.populationIncrease times as many
+candidates per generation, which helps on functions with many local minima.
+Candidates are sampled and evaluated on the workers, and the covariance
+matrix is updated on them in blocks of rows. Its eigendecomposition runs on a
+background thread while the next generation is evaluated, so each generation
+samples from the previous generation's matrix. Runs are reproducible from the
+seed for any number of workers, and the StoppingCriteria apply as for the PSO.
+example/cmaes.cpp minimizes a rotated ellipsoid.
+
+DifferentialEvolutionOptimizer runs Differential Evolution on the same
+workers, either as rand/1/bin with fixed F and CR or as current-to-pbest/1/bin
+with an archive and the adaptive F and CR of JADE. All trial vectors of a
+generation are made in parallel from the population as it was before it and
+evaluated with their parent's fitness-value as cutoff. A trial only ever
+replaces its own parent, so selection runs in parallel without locks. Runs
+are reproducible from the seed for any number of workers.
+
+PSOParameters.refineCount adds a memetic refinement stage to
+ParticleSwarmOptimizer. After a swarm, or as soon as its best has not
+improved for refineStall generations, compass searches start from the best
+personal bests that are at least refineStep apart. Every search steps in both
+directions of each parameter, moves to the best improvement and doubles its
+step, or halves the step when there is none. The stencils of all searches are
+evaluated together on the workers, with each search's fitness-value as cutoff.
+On smooth problems this reaches high precision in far fewer evaluations than
+letting the swarm polish the optimum.
+
 Example
 =======
 
@@ -89,15 +200,21 @@ END OF DOCUMENTATION
 #ifndef OPTIMIZER_H_
 #define OPTIMIZER_H_
 
-#include <list>
 #include <vector>
 #include <string>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
-#include <random>
+#include <cstdint>
 #include <iostream>
+#include <chrono>
+#include <limits>
+
+#include "Dispatcher.h"
+#include "EvaluationCache.h"
+#include "WorkerCounters.h"
+#include "Affinity.h"
 
 namespace PAO
 {
@@ -110,7 +227,8 @@ namespace PAO
 	class MasterOptimizer;
 
 
-	/** Return a random number in (min,max) */
+	/** Return a random number in [min,max).
+	 *  Each thread draws from its own stream, see setRandomSeed(). */
 	double randomBetween( double min, double max );
 
 
@@ -161,15 +279,59 @@ namespace PAO
 	 *
 	 *****************************************************************/
 
+	/** Memory layout of the candidates given to OptimizationWorker::fitnessFunctionBatch */
+	enum BatchLayout_t {
+		RowMajor,	///< Candidate c, dimension j at [c*dimensions + j]
+		ColumnMajor	///< Candidate c, dimension j at [j*count + c]
+	};
+
+	/** Passed to OptimizationWorker::fitnessFunction with each candidate.
+	 *
+	 *  A fitness-value at or above cutoff is of no use to the optimizer,
+	 *  e.g. because it is worse than the particle's personal best. A
+	 *  fitness-function summing many terms can stop once the sum reaches
+	 *  cutoff and return it as a lower bound with
+	 *  \code if (sum >= context.cutoff) return context.lowerBound(sum); \endcode
+	 */
+	class EvaluationContext
+	{
+	public:
+		EvaluationContext( double cutoff=std::numeric_limits<double>::infinity() )
+		:		cutoff(cutoff),
+				isLowerBound(false)
+		{}
+
+		/** Mark the returned value as a lower bound of the fitness-value and return it */
+		double lowerBound( double bound ) {isLowerBound = true; return bound;};
+
+		double cutoff;		///< Fitness-values from here on are not needed exactly, infinite if all are
+		bool isLowerBound;	///< Set by lowerBound()
+	};
+
 	/** Classes wishing to be optimized need to inherit this class. */
 	class OptimizationWorker
 	{
 	public:
 		/** Fitness function used for evaluating parameters.
-		 *  A higher value is better. Derived classes need to implement
-		 *  fitnessFunction.
+		 *  A lower value is better. Derived classes need to implement
+		 *  this or the version taking an EvaluationContext.
 		 *  \param parameters Contains parameters used in fitness function. */
-		virtual double fitnessFunction(Parameters &parameters) = 0;
+		virtual double fitnessFunction(Parameters &parameters);
+
+		/** Fitness function that may return early for candidates that
+		 *  cannot be good enough, see EvaluationContext. Lower bounds are
+		 *  never cached and never become bests. The default calls
+		 *  fitnessFunction(parameters). */
+		virtual double fitnessFunction(Parameters &parameters, EvaluationContext &context);
+
+		/** Evaluate several candidates in one call.
+		 *  Override together with setBatchSize() to vectorize over candidates
+		 *  or to amortize setup. The default calls fitnessFunction once per candidate.
+		 *  \param candidates count*dimensions values laid out as set with setBatchSize().
+		 *  \param count Number of candidates, at most the batch size.
+		 *  \param fitness Receives the fitness-value of each candidate. */
+		virtual void fitnessFunctionBatch( const double* candidates, unsigned count,
+				unsigned dimensions, double* fitness );
 
 		/** Constructor is executed once per worker and should be
 		 * 	used for preprocessing and initializing data.
@@ -180,7 +342,9 @@ namespace PAO
 
 		/** Sets a MasterOptimizer for this worker.
 		 * Called by MasterOptimizer*/
-		void setMaster( MasterOptimizer* master) {this->master = master;};
+		void setMaster( MasterOptimizer* master, unsigned index );
+		/** Returns the index of this worker among the workers of its MasterOptimizer */
+		unsigned getIndex() {return index;};
 
 		/** Return pointer to a new worker of same type for spawning an additional thread.
 		 * 	Caller is responsible for deleting. */
@@ -191,11 +355,46 @@ namespace PAO
 		/** Sends a cancellation request to thread running OptimizationWorker.
 		 *  Destructor is called during this call. */
 		void cancelWorker();
-		/** Returns true if worker is scheduled to stop and exit thread. */
-		bool shouldStop() {return stop;};
+		/** Returns true if worker is scheduled to stop and exit thread, or if
+		 *  the evaluation in progress should be abandoned: it has taken longer
+		 *  than the master's evaluation timeout, a speculative copy of it has
+		 *  finished first or the optimization is stopping. Long fitness-functions
+		 *  should poll this and return early, the value they return is then ignored. */
+		bool shouldStop();
+
+		/** Copy the dimensions first values of x into a Parameters and
+		 *  return the result of fitnessFunction for it.
+		 *  Uses the master's EvaluationCache if enabled.
+		 *  \param cutoff See EvaluationContext. A lower bound is returned
+		 *  as at least cutoff, so that it never compares as better than it.
+		 *  \param lowerBound If not 0, set to whether a lower bound was returned */
+		double evaluate( const double* x, unsigned dimensions,
+				double cutoff=std::numeric_limits<double>::infinity(), bool* lowerBound=0 );
+		/** Return the result of fitnessFunction for parameters, using the cache if enabled */
+		double evaluate( Parameters &parameters );
+
+		/** Evaluate count points stored row by row, stride doubles apart,
+		 *  passing them to fitnessFunctionBatch in blocks of the batch size.
+		 *  \param cutoffs Cutoff of every point, or 0. Not used with batches.
+		 *  \param lowerBounds If not 0, set to 1 for every point whose
+		 *  fitness-value is only a lower bound and to 0 for the others. */
+		void evaluate( const double* rows, unsigned stride, unsigned count, unsigned dimensions, double* fitness,
+				const double* cutoffs=0, unsigned char* lowerBounds=0 );
+
+		/** Allocate the buffers used by evaluate() anew from the calling
+		 *  thread, so that they are placed on its NUMA node and a worker
+		 *  getting its first items late in a run does not allocate then. */
+		void reserveBuffers();
+
+		/** Set the number of candidates fitnessFunctionBatch prefers per
+		 *  call and how they should be laid out. The MasterOptimizer hands
+		 *  out work in multiples of size. */
+		void setBatchSize( unsigned size, BatchLayout_t layout=RowMajor );
+		unsigned getBatchSize() {return batchSize;};
+		BatchLayout_t getBatchLayout() {return batchLayout;};
 
 		/** Thread does work in this function until all work is done.
-		 * Responsible for locking/getting input data, starting simulation, and locking/saving output. */
+		 * Waits for jobs from the master's Dispatcher and processes them until stopped. */
 		void doWork();
 
 		/** Save current parameters to file 
@@ -214,16 +413,79 @@ namespace PAO
 		/** Get current parameter bounds */
 		ParameterBounds& getParameterBounds() {return parameterBounds;}; //Todo: make return const
 
+		/** Item of the MasterOptimizer's current job that the next evaluations
+		 *  belong to, or NoEvaluationItem. Lets idle workers find stragglers. */
+		void setEvaluationItem( unsigned item ) {evaluationItem = item;};
+		/** Identifies the evaluation in progress: a sequence number in the
+		 *  high and the item in the low 32 bits. May be read from any thread. */
+		uint64_t getEvaluationToken() {return evaluationToken;};
+		/** Nanoseconds since the evaluation in progress was started, if any */
+		int64_t getEvaluationAge();
+		/** Make shouldStop() return true if token is still the evaluation in
+		 *  progress. May be called from any thread. */
+		void cancelEvaluation( uint64_t token ) {cancelledToken = token;};
+
+	protected:
+		/** Seconds an evaluation may take, 0 without timeout. See MasterOptimizer::setEvaluationTimeout() */
+		double getEvaluationTimeout();
+		/** Fitness-value given to evaluations that time out */
+		double getTimeoutPenalty();
+		/** Count evaluations given up by a derived class */
+		void addTimeouts( unsigned count );
+		/** Return true if the derived class gives up evaluations that time out
+		 *  itself, so that their results are not replaced by the penalty again */
+		virtual bool enforcesTimeout() {return false;};
+
 	private:
 
+		/** Start timing an evaluation of count candidates */
+		void beginEvaluation( unsigned count );
+		/** Stop timing the evaluation of count candidates. Fitness-values
+		 *  of an evaluation that timed out are replaced by the penalty and
+		 *  those of an abandoned evaluation by the largest double.
+		 *  \return false if fitness should not be remembered, e.g. cached. */
+		bool endEvaluation( double* fitness, unsigned count );
+
+		/** Pack rows[indices[c]*stride] for c<n and pass them to fitnessFunctionBatch.
+		 *  indices may be 0 for consecutive rows.
+		 *  \return false if the results should not be cached, see endEvaluation() */
+		bool evaluateBatch( const double* rows, unsigned stride, const unsigned* indices, unsigned n,
+				unsigned dimensions, double* fitness );
+		/** As evaluate() but looks up every row in cache first */
+		void evaluateCached( EvaluationCache* cache, const double* rows, unsigned stride, unsigned count,
+				unsigned dimensions, double* fitness );
+
 		Parameters parameters;
 		ParameterBounds parameterBounds;
+		Parameters candidate; ///< Reused by evaluate()
+		std::vector<double> batch; ///< Candidates packed for fitnessFunctionBatch
+		std::vector<double> batchFitness;
+		std::vector<unsigned> reserved;	///< Rows this worker has reserved in the cache
+		std::vector<unsigned> busy;		///< Rows some other worker is evaluating
+		std::vector<EvaluationCache::Key> keys;	///< Keys of the rows of evaluateCached()
+		EvaluationCache::Key pointKey;	///< Key of the point of evaluate(x), which evaluateCached() calls while using keys
+		unsigned batchSize;
+		BatchLayout_t batchLayout;
 
 		MasterOptimizer* master;
+		unsigned index;
+		WorkerCounters* counters;	///< Counters of this worker in the master's Dispatcher, or 0
 		std::thread *thrd;
 		std::atomic<bool> stop;
+
+		unsigned evaluationItem;
+		uint32_t evaluationSequence;
+		std::atomic<uint64_t> evaluationToken;	///< See getEvaluationToken()
+		std::atomic<uint64_t> cancelledToken;
+		std::atomic<int64_t> evaluationStarted;	///< Clock ticks, 0 when not evaluating
+		WorkerCounters::Clock::time_point evaluationDeadline;	///< When the evaluation in progress times out
+		bool evaluationTimed;		///< Whether evaluationDeadline is set
+		bool evaluationAbandoned;	///< shouldStop() asked the evaluation in progress to return early
 	};
 
+	/** Value of OptimizationWorker::setEvaluationItem() outside of jobs of items */
+	const unsigned NoEvaluationItem = 0xFFFFFFFF;
+
 	/* Function used when starting worker in new thread.
 	 * Todo: Should not be public*/
 	void* startOptimizationWorkerThread( void* pOptimizationWorker );
@@ -237,6 +499,47 @@ namespace PAO
 	 *****************************************************************/
 
 
+	/** Why optimize() returned, see StoppingCriteria */
+	enum StopReason_t {
+		StopCompleted,			///< All generations were run
+		StopTargetReached,		///< The best fitness-value reached targetFitness
+		StopStalled,			///< The best fitness-value did not improve for stallGenerations
+		StopConverged,			///< The diversity of the population fell below minDiversity
+		StopEvaluationLimit,	///< maxEvaluations evaluations were made
+		StopDeadline,			///< maxSeconds have passed
+		StopCallback,			///< The function set with setCallbackStop() returned true
+		StopRequested			///< MasterOptimizer::requestStop() was called
+	};
+
+	/** Returns a short description of reason */
+	const char* getStopReasonName( StopReason_t reason );
+
+	/** Conditions that end optimize() before all generations have been run.
+	 *  Each is disabled by its default value. When one is met, no new
+	 *  evaluations are started, the ones in progress are finished and
+	 *  the best solution found is returned. */
+	class StoppingCriteria
+	{
+	public:
+		StoppingCriteria()
+		:		targetFitness(-std::numeric_limits<double>::infinity()),
+				stallGenerations(0),
+				stallTolerance(0),
+				minDiversity(0),
+				maxEvaluations(0),
+				maxSeconds(0)
+		{}
+
+		double targetFitness;		///< Stop when the best fitness-value is at or below this
+		unsigned stallGenerations;	///< Stop after this many generations without improvement
+		double stallTolerance;		///< Improvements of at most this much do not count
+		double minDiversity;		///< Stop when the spread of the population, see MasterOptimizer::diversity(), falls below this
+		uint64_t maxEvaluations;	///< Stop after this many calls of fitnessFunction. Cache hits do not count.
+		double maxSeconds;			///< Stop this many seconds after optimize() was called.
+									///< Evaluations of a generation not yet started are skipped.
+	};
+
+
 	/** Entity responsible for setting up worker-threads and dividing work among them.
 	 * MasterOptimizer contains the virtual optimize() which contains the optimization algorithm.
 	 * This function is implemented in by derived classes such as ParticleSwarmOptimizer
@@ -264,22 +567,56 @@ namespace PAO
 		*   Todo: Let user pick filename*/
 		void loadBestParams();
 
-		/** Notify workers */
+		/** Wake workers so that they check if they should stop */
 		void notifyWorkers();
 
-		/** Block until optimizing algorithm sends start signal */
-		void waitForStartSignal(std::unique_lock<std::mutex> &lock);
-		void waitForStartSignal();
-
-
-		/** Block until all data scheduled for computation have been computed.
-		 * 	\param itemsToProcess The total number of packets on indata queue.*/
-		void waitUntilProcessed( unsigned itemsToProcess );
-
-		/** Fetch OptimizationData from the input queue.
-		 * 	The number of items fetched depends on chunkSize */
-		std::list<PAO::OptimizationData*> fetchChunkOfIndata();
-		void pushToOutdata( std::list<OptimizationData*> &data );
+		/** Dispatcher handing out work to the worker threads */
+		Dispatcher& getDispatcher() {return dispatcher;};
+
+		/** Set how evaluations are divided among the workers. Defaults to
+		 *  AdaptiveSchedule, which sizes chunks from the measured cost of an
+		 *  evaluation. StaticSchedule has the least overhead when all
+		 *  evaluations cost the same. */
+		void setSchedulePolicy( SchedulePolicy_t policy ) {schedule = policy;};
+		SchedulePolicy_t getSchedulePolicy() {return schedule;};
+
+		/** Pin the worker threads to cpus. Each worker then reallocates its
+		 *  buffers from its new cpu. Call before optimize(), which places
+		 *  every worker's share of the particles on that worker's node.
+		 *  See also createLocalWorkers().
+		 *  \param cpus The cpu of each worker for ExplicitAffinity */
+		void setAffinity( AffinityPolicy_t policy, std::vector<unsigned> cpus=std::vector<unsigned>() );
+		/** Cpu of each worker, -1 for workers that are not pinned */
+		const std::vector<int>& getWorkerCpus() {return workerCpus;};
+
+		/** Cache fitness-values of points closer than relativeTolerance times
+		 *  the range of each parameter, and collapse concurrent evaluations
+		 *  of the same point into one. Useful for expensive fitness-functions.
+		 *  Which point of a cell gets evaluated depends on timing, so runs
+		 *  are no longer exactly reproducible from the seed.
+		 *  \param maxEntries Number of points remembered. */
+		void enableEvaluationCache( double relativeTolerance, unsigned maxEntries );
+		/** Returns the cache, or 0 if not enabled */
+		EvaluationCache* getEvaluationCache() {return cache.get();};
+
+		/** Give up evaluations taking longer than seconds, 0 disables the timeout.
+		 *  fitnessFunction must poll OptimizationWorker::shouldStop() to be
+		 *  given up before it returns, a ProcessWorker kills its child instead.
+		 *  Points that time out get penalty as fitness-value and are not cached.
+		 *  A batch may take seconds per candidate. */
+		void setEvaluationTimeout( double seconds, double penalty=std::numeric_limits<double>::max() );
+		double getEvaluationTimeout() {return evaluationTimeout;};
+		double getTimeoutPenalty() {return timeoutPenalty;};
+
+		/** Let workers that have run out of points in a generation evaluate
+		 *  again points that other workers have spent more than factor times
+		 *  the mean evaluation time on. Whichever evaluation finishes first is
+		 *  used and the other one is told to stop through shouldStop(), so
+		 *  this only pays off if fitnessFunction polls it, and only works
+		 *  if fitnessFunction is deterministic. Not used with batches or the
+		 *  evaluation cache. 0 disables speculation, the default. */
+		void setSpeculation( double factor ) {speculationFactor = factor;};
+		double getSpeculation() {return speculationFactor;};
 
 		/** Returns the best solution found so far. See optimize().*/
 		OptimizationData* getBestParameters() {return &bestParameters;};
@@ -290,29 +627,169 @@ namespace PAO
 		 */
 		void setCallbackNewMinimum(void(*fun)(double y, double progress ));;
 
+		/** Register function called after every generation.
+		 * 	\param fun Function handle taking the number of generations done and the best value so far.
+		 */
+		void setCallbackGeneration(void(*fun)(unsigned generation, double y ));
+
+		/** Set when optimize() may stop early. Checked after every
+		 *  generation, and after every evaluation by asynchronous updates. */
+		void setStoppingCriteria( const StoppingCriteria &criteria ) {stoppingCriteria = criteria;};
+		const StoppingCriteria& getStoppingCriteria() {return stoppingCriteria;};
+		/** Register function called after every generation that stops
+		 *  the optimization by returning true.
+		 * 	\param fun Function handle taking the number of generations done and the best value so far. */
+		void setCallbackStop(bool(*fun)(unsigned generation, double y ));
+		/** Make the optimize() in progress return as soon as the evaluations
+		 *  being done are finished. May be called from any thread. */
+		void requestStop();
+		/** Why the last optimize() returned */
+		StopReason_t getStopReason() {return stopReason;};
+
+		/** Set the seed of all random numbers used by the optimizer.
+		 *  The same seed gives the same search regardless of the number of workers,
+		 *  as long as fitnessFunction is deterministic. Defaults to the current time. */
+		void setSeed( uint64_t seed );
+		uint64_t getSeed() {return seed;};
+
+		/** Fraction of the workers' time spent evaluating fitnessFunction
+		 *  since the optimization was started. */
+		double getUtilization();
+		/** Copy the counters of every worker into statistics.
+		 *  May be called from another thread while optimizing. */
+		void getWorkerStatistics( std::vector<WorkerStatistics> &statistics );
+		/** Sum of the counters of all workers */
+		WorkerStatistics getTotalStatistics();
+		/** Seconds the optimizing thread has waited for parallel work on the
+		 *  workers since the optimization was started. The rest of its time
+		 *  was spent in serial work between parallel phases. */
+		double getParallelTime() {return parallelSeconds;};
+
 	protected:
 
-		std::mutex inmutex;
-		std::mutex outmutex;
-		std::atomic<bool> workersDone;
+		/** Evaluate fitnessFunction for count items in parallel on the workers
+		 *  and block until all fitness-values have been set. If the optimization
+		 *  is stopped meanwhile, items that were not evaluated get the largest double. */
+		void evaluate( OptimizationData** data, unsigned count );
+
+		/** Evaluate count points stored row by row, stride doubles apart,
+		 *  and write their fitness-values to fitness. Points skipped because
+		 *  the optimization was stopped get the largest double.
+		 *  \param cutoffs Value below which the fitness-value of each point
+		 *  is needed exactly, or 0. See EvaluationContext.
+		 *  \param lowerBounds If not 0, set to 1 for every point whose
+		 *  fitness-value is only a lower bound of its cutoff or more. */
+		void evaluate( const double* rows, unsigned stride, unsigned count, double* fitness,
+				const double* cutoffs=0, unsigned char* lowerBounds=0 );
+
+		/** Call fun for chunks of the range [0,count) in parallel on the worker
+		 *  threads and block until all have returned. */
+		void parallelFor( unsigned count, unsigned chunkSize, const JobFunction& fun,
+				SchedulePolicy_t policy=DynamicSchedule );
+
+		/** Largest batch size among the workers */
+		unsigned getBatchSize();
+
+		/** Start measuring utilization from now. See getUtilization(). */
+		void resetUtilization();
+
+		/** Start the clock and counts of the stopping criteria. Called at the start of optimize(). */
+		void resetStopping();
+		/** Check the stopping criteria that do not depend on generations.
+		 *  Cheap enough to call after every evaluation. Not thread-safe.
+		 *  \return true if the optimization should stop, see stopReason. */
+		bool checkStop( double bestFitness );
+		/** Check all stopping criteria after a generation.
+		 *  \param diversity Spread of the population, or a negative value if not computed.
+		 *  \return true if the optimization should stop, see stopReason. */
+		bool checkGeneration( unsigned generation, double bestFitness, double diversity );
+		/** True if checkGeneration() needs the diversity */
+		bool wantsDiversity() {return stoppingCriteria.minDiversity > 0;};
+		/** True once a stopping criterion has been met */
+		bool isStopping() {return stopReason != StopCompleted;};
+		/** Spread of count points stored row by row, stride doubles apart:
+		 *  the root mean square deviation from their mean, with each
+		 *  parameter scaled by its range. About 0.29 for points spread
+		 *  uniformly over the bounds and 0 when all points coincide. */
+		double diversity( const double* rows, unsigned stride, unsigned count );
+		/** Number of calls of fitnessFunction made by all workers */
+		uint64_t countEvaluations();
+
+		Dispatcher dispatcher;
 
 		std::vector<OptimizationWorker*> workers;
-		unsigned chunkSize;	//<! Size of chunk grabbed by fetchChunkOfIndata
+		unsigned chunkSize;	//<! Number of items grabbed at a time by a worker during evaluate(), or the smallest number with guided and adaptive schedules
+		SchedulePolicy_t schedule;	//<! How evaluate() divides items into chunks
+		std::vector<int> workerCpus;	//<! Set by setAffinity()
 		OptimizationWorker* originalWorker;
 		ParameterBounds* paramBounds;
 
 		OptimizationData bestParameters;
-
-
-		std::list<OptimizationData*> indataList;
-		std::list<OptimizationData*> outdataList;
+		uint64_t seed;
+		std::unique_ptr<EvaluationCache> cache;
 
 		void (*callbackFoundNewMinimum)(double y, double progress );
+		void (*callbackGeneration)(unsigned generation, double y );
+		bool (*callbackStop)(unsigned generation, double y );
+
+		StoppingCriteria stoppingCriteria;
+		StopReason_t stopReason;
 
 	private:
-		std::condition_variable indataReady;
-		std::condition_variable outdataReady;
 
+		/** Run a job on the dispatcher, adding the time to parallelSeconds */
+		void runJob( unsigned count, unsigned chunkSize, const JobFunction& fun, SchedulePolicy_t policy,
+				bool interruptible=false, const IdleFunction* idle=0 );
+
+		/** Arguments of the evaluate() of rows in progress. Kept here so that
+		 *  its job only captures this and fits in a JobFunction without allocating. */
+		class RowJob
+		{
+		public:
+			const double* rows;
+			unsigned stride;
+			unsigned count;
+			unsigned dimensions;
+			unsigned batch;
+			double* fitness;
+			const double* cutoffs;
+			unsigned char* lowerBounds;
+			bool speculative;	///< Rows are evaluated one at a time and may be duplicated
+		};
+		/** Evaluate blocks [begin,end) of rowJob */
+		void evaluateRows( OptimizationWorker* worker, unsigned begin, unsigned end );
+		/** Cutoff of row i of rowJob */
+		double cutoffOf( unsigned i ) {return rowJob.cutoffs ? rowJob.cutoffs[i] : std::numeric_limits<double>::infinity();};
+		/** Evaluate in worker a row of rowJob that another worker has spent long on.
+		 *  \return false if no row is left that could need it */
+		bool speculate( OptimizationWorker* worker );
+		/** Store fitness of row i of rowJob evaluated by worker, unless another
+		 *  evaluation of it finished first, and stop the other one */
+		void finishRow( OptimizationWorker* worker, unsigned i, double fitness, bool lowerBound );
+
+		/** State of a row of a speculative rowJob */
+		enum RowState_t {RowPending, RowDuplicated, RowDone};
+
+		RowJob rowJob;
+		std::unique_ptr<std::atomic<unsigned char>[]> rowStates;	///< RowState_t of every row
+		unsigned rowStateCount;
+		IdleFunction speculateJob;	///< Calls speculate(), made once so running it does not allocate
+		double evaluationTimeout;
+		double timeoutPenalty;
+		double speculationFactor;
+		std::vector<double> gatherRows;		///< Rows gathered from OptimizationData for batches
+		std::vector<double> gatherFitness;
+
+		std::atomic<bool> stopRequested;
+		std::chrono::steady_clock::time_point deadline;	///< When maxSeconds have passed
+		uint64_t evaluationsBase;	///< countEvaluations() when stopping was reset
+		double stallFitness;		///< Best fitness-value when it last improved
+		unsigned stallGeneration;	///< Generation it improved in
+		std::vector<double> diversitySums;	///< Scratch of diversity(), two per parameter
+
+		std::chrono::steady_clock::time_point utilizationStart;
+		double utilizationBase;	///< Evaluation time of all workers when utilization was reset
+		double parallelSeconds;
 
 		/** Simple brute force algorithm */
 		void optimizeBruteforce();
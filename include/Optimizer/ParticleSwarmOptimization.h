@@ -29,6 +29,10 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define PARTICLESWARMOPTIMIZATION_H_
 
 #include "Optimizer.h"
+#include "SwarmStore.h"
+#include "Random.h"
+#include "Checkpoint.h"
+#include "Surrogate.h"
 
 namespace PAO
 {
@@ -38,36 +42,85 @@ namespace PAO
 		NeighborhoodBest ///< Neighborhood-best variant, particles tend to the neighborhood's best particle
 	};
 
+	enum PSOUpdate_t {
+		SynchronousUpdate, ///< All particles are evaluated before any particle is moved
+		AsynchronousUpdate ///< A particle is moved and resubmitted as soon as its own evaluation is done
+	};
+
+	enum SwarmMode_t {
+		SequentialSwarms, ///< Swarms are run one after another
+		IslandSwarms ///< All swarms run at the same time as islands, exchanging their best particles
+	};
+
+	enum MigrationTopology_t {
+		RingMigration, ///< Island k receives the best particles of island k-1
+		FullyConnectedMigration ///< Each island receives the best particles among all other islands
+	};
+
 	/** Class specifying behaviour of PSO-algorithm. */
 	class PSOParameters
 	{
 	public:
 		PSOParameters()
 		:		variant(PopulationBest),
+		 		update(SynchronousUpdate),
 		 		swarms(10),
 		 		particleCount(1000),
 		 		generations(100),
 		 		c1(0.7),
-		 		c2(0.2)
+		 		c2(0.2),
+		 		swarmMode(SequentialSwarms),
+		 		migrationTopology(RingMigration),
+		 		migrationInterval(10),
+		 		migrants(1),
+		 		checkpointInterval(0),
+		 		checkpointFile("pso.checkpoint"),
+		 		surrogateFraction(0),
+		 		surrogateNeighbors(8),
+		 		surrogateCapacity(20000),
+		 		refineCount(0),
+		 		refineStall(0),
+		 		refineStallTolerance(0),
+		 		refineStep(0.01),
+		 		refineMinStep(1e-9),
+		 		refineIterations(1000)
 		{}
 
 		PSOVariant_t variant;		///< Which type of PSO to use
+		PSOUpdate_t update;			///< Whether generations are separated by a barrier.
+									///< Asynchronous update keeps workers busy when evaluation times vary,
+									///< but results are no longer reproducible from the seed.
 		unsigned swarms;			///< Number of different swarms to generate
 		unsigned particleCount;		///< Number of particles in each swarm
 		unsigned generations;		///< Number of generations (steps) to perform
 		double c1;					///< Influence of previous local best particle position
 		double c2;					///< Influence of population or neighborhood best particle position
-	};
 
-	/** Class used by ParticleSwarmOptimizer */
-	class SwarmParticle
-	{
-	public:
-		OptimizationData x; ///< Current position of particle
-		OptimizationData p; ///< Previous local best particle position
-		OptimizationData* l; ///< Neighborhood best particle position
-		std::vector<double> v; ///< Velocity vector
+		SwarmMode_t swarmMode;		///< Whether swarms run one after another or concurrently as islands
+		MigrationTopology_t migrationTopology; ///< Which islands exchange particles
+		unsigned migrationInterval;	///< Generations between migrations, 0 disables migration
+		unsigned migrants;			///< Number of particles sent by each island at a migration
 
+		unsigned checkpointInterval;	///< Generations between checkpoints, 0 disables checkpoints.
+										///< Only written with synchronous update.
+		std::string checkpointFile;		///< Where checkpoints are written, see ParticleSwarmOptimizer::resume()
+
+		double surrogateFraction;		///< Fraction of each island evaluated per generation, chosen by a
+										///< SurrogateModel of earlier results. 0 evaluates every particle.
+										///< Only used with synchronous update.
+		unsigned surrogateNeighbors;	///< Points each surrogate prediction is based on
+		unsigned surrogateCapacity;		///< Evaluated points kept by the surrogate
+
+		unsigned refineCount;			///< Pattern searches started from the best distinct personal bests
+										///< after each swarm, 0 disables refinement
+		unsigned refineStall;			///< Hand a swarm over to refinement after this many generations
+										///< without improvement, 0 runs all generations first.
+										///< Only used with synchronous update.
+		double refineStallTolerance;	///< Improvements of at most this much do not count
+		double refineStep;				///< Starting step as a fraction of each parameter's range. Starting
+										///< points are at least this far apart in some parameter.
+		double refineMinStep;			///< A search ends when its step falls below this fraction
+		unsigned refineIterations;		///< Steps taken by each search at most
 	};
 
 	/** Implements the Particle Swarm Optimization for finding parameter-sets that 
@@ -89,11 +142,151 @@ namespace PAO
 
 		double optimize();
 
+		/** Continue the run saved in a checkpoint written during optimize().
+		 *  The optimizer must be created with the same parameters as the
+		 *  run that wrote it. Generations after the checkpoint give the same
+		 *  result as if the run had not been interrupted. */
+		double resume( std::string filename );
+
+		/** Number of evaluations the surrogate saved during the last run */
+		uint64_t getSurrogateSavings() {return surrogateSavings;};
+
 	private:
-		
 
+		/** Start of a checkpoint file, followed by positions, personal bests
+		 *  and velocities of all particles, their fitness and best fitness,
+		 *  the best position and fitness of each island and bestParameters. */
+		class CheckpointHeader
+		{
+		public:
+			char magic[8];
+			uint32_t version;
+			uint32_t dimensions;
+			uint64_t fileSize;
+			uint64_t seed;			///< Random streams only depend on seed, swarm and generation
+			uint32_t swarms;
+			uint32_t particleCount;
+			uint32_t islands;
+			uint32_t generations;
+			uint32_t swarm;			///< Swarm being run
+			uint32_t generation;	///< Next generation to run
+			uint32_t stride;
+			uint32_t reserved;
+			double inertia;
+			double bestFitness;
+		};
+
+		/** Best particle of an island found by one worker during updateBests() */
+		class PartialBest
+		{
+		public:
+			double fitness;
+			unsigned index;
+			char padding[2*CacheLineSize - sizeof(double) - sizeof(unsigned)];
+		};
+
+		/** Allocate and initialize the swarm */
+		void initializeSwarm();
+		/** Allocate the swarm of the current run without initializing particles */
+		void allocateSwarm();
+		/** Write the state after the current generation to pso.checkpointFile */
+		void saveCheckpoint();
+		/** Return the header of a checkpoint file if it matches this optimizer */
+		const CheckpointHeader* checkCheckpoint( MappedFile &file );
+		/** Set the allocated swarm to the state saved in a checkpoint */
+		void restoreCheckpoint( const CheckpointHeader* header );
+		/** Run the generations of a swarm, evaluating a whole generation at a time */
+		void runSynchronous();
+		/** Evaluate the particles whose surrogate predictions are best on each
+		 *  island and give the others their prediction */
+		void evaluateScreened( unsigned partition );
+		/** Run pattern searches from the best distinct personal bests of the swarm */
+		void refine();
+		/** Run the evaluation budget of a swarm without barriers. Called once per worker. */
+		void runAsynchronous( OptimizationWorker* worker );
+
+		/** Set up random starting positions for particles [begin,end) */
+		void initializeParticles( OptimizationWorker* worker, unsigned begin, unsigned end );
+		/** Find the neighborhood best of particle i using ring topology within its island */
+		unsigned findNeighborhoodBest( unsigned i );
+		/** Exchange the best particles between islands */
+		void migrate();
+		/** Copy the best personal bests of island k to its migrant rows */
+		void selectEmigrants( unsigned k );
+		/** Replace the worst particles of island k with migrants from other islands.
+		 *  Particles that are being evaluated are left alone. */
+		void receiveImmigrants( unsigned k );
+		/** Move particle i towards its personal best and l.
+		 *  \param random Two rows of scratch space
+		 *  \param substream Random substream of the particle to use */
+		void moveParticle( unsigned i, const double* l, double* random, unsigned substream );
+		/** Largest diversity() of the personal bests of an island, so that
+		 *  islands stuck in different optima do not count as spread */
+		double islandDiversity();
+		/** Copy best of island k into bestParameters if it is better */
+		void updateBestParameters( unsigned k, double progress );
+
+		unsigned islandOf( unsigned i ) {return i/pso.particleCount;};
+		double* islandBest( unsigned k ) {return swarmBest.data() + (size_t)k*store.stride();};
+		/** Find neighborhood best and move particles [begin,end) */
+		void updateParticles( OptimizationWorker* worker, unsigned begin, unsigned end );
+		/** Update personal bests of particles [begin,end) and record
+		 *  the best of them in the PartialBest of worker */
+		void updateBests( OptimizationWorker* worker, unsigned begin, unsigned end );
 
 		PSOParameters pso;
+
+		SwarmStore store;
+		std::vector<unsigned> neighborhoodBest; ///< Index of particle whose personal best is the neighborhood best
+		AlignedArray<double> swarmBest;			///< Best position of each island
+		std::vector<double> swarmBestFitness;	///< One per island
+		double inertia;
+		unsigned swarm;		///< Current run of sequential swarms
+		unsigned islands;	///< Swarms in store
+		unsigned generation;
+
+		AlignedArray<double> randomNumbers;		///< Three rows of scratch per worker
+		std::vector<PartialBest> partialBests;	///< One per worker and island
+
+		AlignedArray<double> migrantRows;		///< migrants rows per island
+		std::vector<double> migrantFitness;
+		std::vector<unsigned> migrantIndex;
+		std::vector<unsigned char> particleBusy; ///< Set while a particle is being evaluated asynchronously
+
+		// State of asynchronous update, guarded by asyncMutex
+		std::mutex asyncMutex;
+		std::vector<unsigned> readyParticles;	///< Ring of particles waiting to be moved
+		unsigned readyHead;
+		unsigned readyCount;
+		std::vector<unsigned> particleEvaluations;
+		unsigned evaluationsIssued;
+		unsigned evaluationsCompleted;
+		unsigned evaluationBudget;
+		unsigned nextMigration;
+
+		// Surrogate pre-screening of synchronous update
+		std::unique_ptr<SurrogateModel> surrogate;
+		std::vector<double> predictions;		///< One per particle
+		std::vector<unsigned> screenOrder;		///< Particles of each island, those to evaluate first
+		AlignedArray<double> screenRows;		///< Positions of the particles to evaluate
+		std::vector<double> screenFitness;
+		std::vector<double> screenCutoffs;
+		std::vector<unsigned char> screenLowerBounds;	///< Evaluations that only gave a lower bound, kept out of the surrogate
+		uint64_t surrogateSavings;
+
+		// Refinement
+		double refineStallFitness;		///< Best fitness-value of the swarm when it last improved
+		unsigned refineStallGeneration;	///< Generation it improved in
+		std::vector<unsigned> refineStarts;	///< Particles sorted by personal best
+		AlignedArray<double> refinePoints;	///< Point of each search
+		std::vector<double> refineFitness;
+		std::vector<double> refineSteps;	///< Step of each search, 0 once it has ended
+		AlignedArray<double> stencilRows;	///< Two points per parameter and search
+		std::vector<double> stencilFitness;
+		std::vector<double> stencilCutoffs;
+
+		CheckpointWriter checkpointWriter;
+		std::string resumeFile;	///< Checkpoint optimize() starts from, if set
 	};
 
 }
@@ -0,0 +1,122 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef PROCESSWORKER_H_
+#define PROCESSWORKER_H_
+
+#include <sys/types.h>
+#include <cstdint>
+
+#include "Optimizer.h"
+
+namespace PAO
+{
+	class ProcessRing;
+
+	/** Worker that evaluates in a child process instead of in its thread.
+	 *
+	 *  For fitness-functions calling code that is not thread-safe or that
+	 *  may crash. Pass one ProcessWorker per thread to the MasterOptimizer.
+	 *  On the first evaluation the worker forks a child process running
+	 *  the fitness-function of evaluator. Candidates and results are
+	 *  exchanged through a ring buffer in shared memory, signalled by
+	 *  process-shared semaphores, so a batch is streamed to the child while
+	 *  earlier candidates are being evaluated. The child evaluates one
+	 *  candidate at a time, whatever the batch size of evaluator, so that
+	 *  a crash or a timeout is blamed on the candidate that caused it.
+	 *
+	 *  If the child dies it is forked again and the candidates it had not
+	 *  finished are sent again. A candidate that has killed the child
+	 *  maxAttempts times gets crashPenalty as fitness-value. With an
+	 *  evaluation timeout set on the MasterOptimizer, a child that takes
+	 *  longer than that on a candidate is killed and the candidate gets
+	 *  the timeout penalty, so a hanging fitness-function needs no polling.
+	 *  A child that does not exit within a second of the worker being
+	 *  destroyed is killed too.
+	 *
+	 *  The child is forked from a process running several threads, so
+	 *  evaluator should not rely on locks held by other threads, e.g. in
+	 *  its constructor.
+	 */
+	class ProcessWorker : public OptimizationWorker
+	{
+	public:
+		/** \param evaluator Worker whose fitness-function runs in the child. Must outlive this.
+		 *  \param batchSize Number of candidates handed to this worker at a time.
+		 *  \param capacity Number of candidates that fit in the ring buffer. */
+		ProcessWorker( OptimizationWorker* evaluator, unsigned batchSize=16, unsigned capacity=64 );
+		virtual ~ProcessWorker();
+
+		virtual double fitnessFunction( Parameters &parameters );
+		virtual void fitnessFunctionBatch( const double* candidates, unsigned count,
+				unsigned dimensions, double* fitness );
+
+		/** Number of times the child process has been restarted */
+		unsigned getRestarts() {return restarts;};
+
+		unsigned maxAttempts;	///< Evaluations of a candidate crashing the child before giving up, default 3
+		double crashPenalty;	///< Fitness-value of a candidate given up on, default the largest double
+
+	protected:
+		/** The child is killed when a candidate times out, see waitForResult() */
+		virtual bool enforcesTimeout() {return true;};
+
+	private:
+		/** Map the ring buffer for dimensions and fork the first child */
+		void start( unsigned dimensions );
+		void forkChild();
+		/** Child process main loop, never returns */
+		void runChild();
+		/** Wait until the next result is ready, restarting a dead or timed out child */
+		void waitForResult();
+		/** Fork a new child after the previous one died.
+		 *  \param timedOut The child was killed for taking too long */
+		void restart( bool timedOut );
+		void shutdown();
+
+		OptimizationWorker* evaluator;
+		unsigned capacity;
+		unsigned dims;
+
+		ProcessRing* ring;	///< Header of the shared mapping
+		double* slots;		///< capacity*dims candidate values following the header
+		double* results;	///< capacity fitness-values following slots
+		size_t mappedSize;
+
+		pid_t child;
+		pid_t parent;
+		uint64_t issued;	///< Candidates written to the ring since start
+		uint64_t completed;	///< Results read from the ring since start
+		uint64_t childStart;	///< First candidate the next forked child evaluates
+		uint64_t crashPosition;	///< Candidate being evaluated at the last crash
+		unsigned crashCount;	///< Number of consecutive crashes at crashPosition
+		unsigned restarts;
+		WorkerCounters::Clock::time_point lastResult;	///< When the child last made progress
+	};
+}
+
+#endif /* PROCESSWORKER_H_ */
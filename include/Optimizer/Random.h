@@ -0,0 +1,80 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#include <cstdint>
+
+namespace PAO
+{
+	/** Stream of uniform random numbers from the Philox4x32-10 counter-based generator.
+	 *
+	 *  The n:th number of a stream is a pure function of (seed, stream,
+	 *  substream, n), so any number of streams can be created cheaply and
+	 *  used from different threads without shared state. Giving every
+	 *  particle its own stream makes a run reproducible from a single seed
+	 *  regardless of how work is divided among threads.
+	 */
+	class RandomStream
+	{
+	public:
+		/** \param seed The user-visible seed, used as key.
+		 *  \param stream Identifies the stream, e.g. a particle.
+		 *  \param substream Identifies a part of the stream, e.g. a generation. */
+		RandomStream( uint64_t seed, uint64_t stream, uint32_t substream=0 );
+
+		/** Return a random number in [0,1) */
+		double uniform();
+		/** Return a random number in [min,max) */
+		double uniform( double min, double max ) {return uniform()*(max-min) + min;};
+		/** Return a standard normal random number, using two uniform numbers */
+		double normal();
+
+		/** Fill out with n random numbers in [min,max).
+		 *  Several counters are processed in lockstep so the compiler can
+		 *  vectorize the rounds. */
+		void fill( double* out, unsigned n, double min=0, double max=1 );
+
+		/** Return the four 32-bit words of block number counter */
+		static void block( uint64_t seed, uint32_t counter[4], uint32_t result[4] );
+
+	private:
+		uint64_t seed;
+		uint32_t counter[4]; ///< Block index, substream, stream (low), stream (high)
+
+		uint32_t buffer[4];
+		unsigned buffered; ///< Words left in buffer
+	};
+
+	/** Set the seed used by randomBetween() in all threads. */
+	void setRandomSeed( uint64_t seed );
+	/** Returns the seed used by randomBetween() */
+	uint64_t getRandomSeed();
+}
+
+#endif /* RANDOM_H_ */
@@ -0,0 +1,194 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef REMOTE_H_
+#define REMOTE_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "Optimizer.h"
+
+namespace PAO
+{
+	/** Types of messages between a RemoteWorkerPool and runRemoteWorker */
+	enum MessageType_t {
+		HelloMessage = 1,		///< Worker to master, dimensions of the worker's problem
+		EvaluateMessage = 2,	///< Master to worker, count*dimensions candidates
+		ResultMessage = 3,		///< Worker to master, count fitness-values
+		HeartbeatMessage = 4,	///< Worker to master, sent periodically
+		ShutdownMessage = 5		///< Master to worker, the worker returns
+	};
+
+	/** Header of every message, followed by a payload of doubles for
+	 *  evaluate and result messages. All values are in the byte order of
+	 *  the sender, so master and workers must share byte order. */
+	class MessageHeader
+	{
+	public:
+		uint32_t magic;			///< MessageMagic, also rejects peers of another byte order
+		uint32_t type;			///< MessageType_t
+		uint64_t batchId;		///< Pairs a result with its evaluate message
+		uint32_t count;			///< Number of candidates
+		uint32_t dimensions;	///< Values per candidate
+	};
+
+	const uint32_t MessageMagic = 0x50414F31; // "PAO1"
+	/** Most candidates in one message, a peer sending more is dropped */
+	const uint32_t MaxBatch = 4096;
+
+	/** Hands out candidates to worker processes connected over TCP.
+	 *
+	 *  Remote hosts run runRemoteWorker(), e.g. through the pao_worker
+	 *  example, and connect to the port the pool listens on. Locally the
+	 *  pool is used through RemoteWorker objects given to a MasterOptimizer.
+	 *
+	 *  Candidates are sent in messages of at most messageSize candidates,
+	 *  and up to pipelineDepth messages are in flight per connection so a
+	 *  worker always has the next batch waiting. A connection that closes
+	 *  or sends no heartbeat within heartbeatTimeout is dropped and its
+	 *  messages are sent to the other workers.
+	 */
+	class RemoteWorkerPool
+	{
+	public:
+		/** Listen for workers on port, or on a free port if port is 0.
+		 *  \param bounds Parameter-space of the problem, workers must have as many dimensions. */
+		RemoteWorkerPool( ParameterBounds bounds, unsigned short port=0 );
+		/** Sends shutdown to all workers and closes connections */
+		~RemoteWorkerPool();
+
+		/** Evaluate count candidates stored row by row, waiting for the
+		 *  result. Blocks while no worker is connected. Thread-safe. */
+		void evaluate( const double* candidates, unsigned count, double* fitness );
+
+		unsigned short getPort() {return port;};
+		ParameterBounds& getParameterBounds() {return bounds;};
+		/** Number of currently connected workers */
+		unsigned getConnectionCount();
+		/** Number of messages sent again after their worker was lost */
+		unsigned getResent() {return resent;};
+
+		unsigned messageSize;	///< Candidates per evaluate message, default 16, at most MaxBatch
+		unsigned pipelineDepth;	///< Messages in flight per connection, default 4
+		std::chrono::milliseconds heartbeatTimeout;	///< Default 5 s
+
+	private:
+		/** Candidates evaluate() waits for */
+		class Request
+		{
+		public:
+			unsigned remaining;	///< Tasks not yet evaluated
+			unsigned sending;	///< Tasks being sent from its candidates
+		};
+
+		/** Part of a request sent as one message */
+		class Task
+		{
+		public:
+			Request* request;
+			const double* candidates;
+			double* fitness;
+			unsigned count;
+			uint64_t batchId;
+		};
+
+		class Connection
+		{
+		public:
+			int socket;
+			std::string peer;
+			std::thread reader;
+			std::mutex sendMutex;
+			std::list<Task> inFlight;
+			std::chrono::steady_clock::time_point lastSeen;
+			unsigned sending;	///< Tasks being sent on it
+			bool ready;		///< Said hello and not lost, tasks may be given to it
+			bool dropped;	///< Shut down for missing heartbeats
+			bool finished;	///< Reader thread is done
+		};
+
+		/** Accepts connections and drops silent ones until stopped */
+		void acceptConnections();
+		/** Reads results and heartbeats from connection until it closes */
+		void readConnection( Connection* connection );
+		/** Give queued tasks to connections with room, must hold mutex.
+		 *  Returns the assignments to be sent after unlocking. */
+		void assignTasks( std::vector<std::pair<Connection*,Task> > &assigned );
+		/** Send an evaluate message for each assigned task */
+		void sendTasks( std::vector<std::pair<Connection*,Task> > &assigned );
+
+		ParameterBounds bounds;
+		unsigned short port;
+		int listener;
+
+		std::mutex mutex;
+		std::condition_variable done;
+		std::deque<Task> queue;
+		std::list<std::unique_ptr<Connection> > connections;
+		uint64_t nextBatchId;
+		unsigned resent;
+		bool waitingReported;
+
+		std::atomic<bool> stop;
+		std::thread acceptor;
+	};
+
+	/** Worker forwarding its candidates to a RemoteWorkerPool.
+	 *  Give a MasterOptimizer several of these, enough to keep all remote
+	 *  workers busy, e.g. one per remote worker. */
+	class RemoteWorker : public OptimizationWorker
+	{
+	public:
+		/** \param batchSize Candidates handed to this worker at a time */
+		RemoteWorker( RemoteWorkerPool &pool, unsigned batchSize=64 );
+
+		virtual double fitnessFunction( Parameters &parameters );
+		virtual void fitnessFunctionBatch( const double* candidates, unsigned count,
+				unsigned dimensions, double* fitness );
+
+	private:
+		RemoteWorkerPool &pool;
+	};
+
+	/** Connect to the RemoteWorkerPool at host:port and evaluate the
+	 *  candidates it sends with worker, until the master shuts down.
+	 *  Retries connecting until the master is up.
+	 *  Returns true if the master sent shutdown, false if the connection was lost. */
+	bool runRemoteWorker( OptimizationWorker &worker, const std::string &host, unsigned short port );
+}
+
+#endif /* REMOTE_H_ */
@@ -0,0 +1,89 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SURROGATE_H_
+#define SURROGATE_H_
+
+#include <vector>
+
+namespace PAO
+{
+	class ParameterBounds;
+
+	/** k-nearest-neighbour regression of fitness-values, used to decide
+	 *  which candidates are worth a real evaluation.
+	 *
+	 *  Points are scaled to the unit cube given by the bounds and kept in a
+	 *  ring of capacity points, so adding a point is a copy and the model
+	 *  never needs to be refitted. A prediction is the inverse squared
+	 *  distance weighted mean of the nearest neighbours. Any number of
+	 *  threads may predict at the same time, but not while points are added.
+	 */
+	class SurrogateModel
+	{
+	public:
+		/** Most neighbours a prediction can use */
+		static const unsigned MaxNeighbors = 32;
+
+		/** \param neighbors Points used by each prediction, at most MaxNeighbors.
+		 *  \param capacity Points kept, the oldest are replaced beyond it. */
+		SurrogateModel( ParameterBounds &bounds, unsigned neighbors, unsigned capacity );
+
+		/** Add the dimensions() first values of count rows, stride values
+		 *  apart, with their fitness-values. Rows whose fitness is not
+		 *  finite or is the largest double, i.e. failed or abandoned
+		 *  evaluations, are left out.
+		 *  \param lowerBounds Rows flagged here by MasterOptimizer::evaluate()
+		 *  are left out too, as their fitness is only a lower bound, or 0. */
+		void add( const double* rows, unsigned stride, unsigned count, const double* fitness,
+				const unsigned char* lowerBounds=0 );
+
+		/** Predict the fitness-value of x.
+		 *  \param scratch dimensions() values the caller does not use meanwhile. */
+		double predict( const double* x, double* scratch ) const;
+
+		/** Drop all points */
+		void clear();
+
+		unsigned dimensions() const {return origin.size();};
+		unsigned getNeighbors() const {return neighbors;};
+		/** Number of points stored */
+		unsigned size() const {return count;};
+
+	private:
+		std::vector<double> origin;
+		std::vector<double> scale;		///< One over the range of each parameter
+		std::vector<double> points;		///< capacity rows of dimensions() scaled values
+		std::vector<double> values;		///< Fitness-value of each row
+		unsigned neighbors;
+		unsigned capacity;
+		unsigned count;
+		unsigned next;	///< Row written by the next add
+	};
+}
+
+#endif /* SURROGATE_H_ */
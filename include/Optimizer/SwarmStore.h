@@ -0,0 +1,115 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SWARMSTORE_H_
+#define SWARMSTORE_H_
+
+#include "Optimizer.h"
+#include "AlignedArray.h"
+
+namespace PAO
+{
+	/** State of all particles in a swarm, stored as structure-of-arrays.
+	 *
+	 *  Positions, personal bests and velocities are each kept in one
+	 *  contiguous array with one row per particle. Rows are padded to
+	 *  stride() doubles so that every row starts on an ArrayAlignment
+	 *  boundary. The padding lanes are kept at zero, as are the padding
+	 *  lanes of the bounds, so kernels may process whole rows.
+	 *
+	 *  Memory is not touched when allocated, so on a NUMA machine a row is
+	 *  placed on the node of the thread that first writes it. Whoever
+	 *  initializes the particles should do so from the threads that will
+	 *  use them.
+	 */
+	class SwarmStore
+	{
+	public:
+		SwarmStore() : particles(0), dims(0), rowStride(0) {};
+
+		/** Allocate room for particleCount particles within bounds.
+		 *  Contents are undefined, see clearPadding(). */
+		void resize( unsigned particleCount, ParameterBounds &bounds );
+		/** Set the padding lanes of particle i to zero */
+		void clearPadding( unsigned i );
+
+		unsigned size() const {return particles;};
+		unsigned dimensions() const {return dims;};
+		unsigned stride() const {return rowStride;};
+
+		double* position( unsigned i ) {return positions.data() + (size_t)i*rowStride;};
+		double* best( unsigned i ) {return bests.data() + (size_t)i*rowStride;};
+		double* velocity( unsigned i ) {return velocities.data() + (size_t)i*rowStride;};
+
+		double& fitness( unsigned i ) {return fitnessValues[i];};
+		double& bestFitness( unsigned i ) {return bestFitnessValues[i];};
+
+		/** Lower bounds, padded to stride() */
+		const double* lower() const {return lowerBounds.data();};
+		/** Upper bounds, padded to stride() */
+		const double* upper() const {return upperBounds.data();};
+
+		/** All positions, size()*stride() doubles */
+		double* positionData() {return positions.data();};
+		/** Current fitness of all particles */
+		double* fitnessData() {return fitnessValues.data();};
+
+	private:
+		unsigned particles;
+		unsigned dims;
+		unsigned rowStride;
+
+		AlignedArray<double> positions;
+		AlignedArray<double> bests;
+		AlignedArray<double> velocities;
+		AlignedArray<double> fitnessValues;
+		AlignedArray<double> bestFitnessValues;
+		AlignedArray<double> lowerBounds;
+		AlignedArray<double> upperBounds;
+	};
+
+
+	/** Updates the velocity and position of one particle:
+	 *
+	 *  	v = inertia*v + c1*r1*(p-x) + c2*r2*(l-x)
+	 *  	x = clamp(x+v, lower, upper)
+	 *
+	 *  where r1 and r2 hold one uniform random number per dimension.
+	 *  All arrays hold n doubles and should be ArrayAlignment-aligned. */
+	typedef void (*VelocityKernel)( double* x, double* v, const double* p, const double* l,
+			const double* r1, const double* r2, const double* lower, const double* upper,
+			unsigned n, double inertia, double c1, double c2 );
+
+	/** Returns the fastest VelocityKernel supported by the running cpu.
+	 *  The choice is made once, on first call. */
+	VelocityKernel getVelocityKernel();
+
+	/** Returns name of the kernel picked by getVelocityKernel(), e.g. "avx2" */
+	const char* getVelocityKernelName();
+}
+
+#endif /* SWARMSTORE_H_ */
@@ -0,0 +1,131 @@
+/** \file
+
+\section LICENSE
+
+The MIT License (MIT)
+
+Copyright (c) 2013 Anders Bennehag
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without
+limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef WORKERCOUNTERS_H_
+#define WORKERCOUNTERS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "Dispatcher.h"
+
+namespace PAO
+{
+	/** Number of buckets in the evaluation time histogram. Bucket b counts
+	 *  evaluations that took between 2^b and 2^(b+1) nanoseconds. */
+	const unsigned LatencyBuckets = 40;
+
+	/** Copy of the counters of a worker, or the sum over several workers */
+	class WorkerStatistics
+	{
+	public:
+		WorkerStatistics();
+		/** Add the counts of other */
+		WorkerStatistics& operator+=( const WorkerStatistics &other );
+		/** Evaluation time in seconds below which a fraction p of evaluations
+		 *  finished, as the upper edge of the histogram bucket */
+		double latencyPercentile( double p ) const;
+
+		uint64_t evaluations;		///< Calls of fitnessFunction, counting each candidate of a batch
+		uint64_t chunks;			///< Chunks of items fetched from the Dispatcher
+		uint64_t steals;			///< Chunks stolen from other workers
+		uint64_t timeouts;			///< Evaluations given up after the evaluation timeout
+		uint64_t speculations;		///< Evaluations duplicated from slow workers
+		uint64_t cutoffs;			///< Evaluations that returned a lower bound at their cutoff
+		double evaluationSeconds;	///< Time spent in the fitness-function
+		double fetchSeconds;		///< Time spent fetching or stealing chunks
+		double lockSeconds;			///< Time spent waiting for locks or results held by other workers
+		double idleSeconds;			///< Time spent waiting for a job
+		uint64_t latencyHistogram[LatencyBuckets];
+	};
+
+	/** Counters of one worker thread.
+	 *
+	 *  Only the worker's own thread writes its counters, so they are
+	 *  updated with relaxed loads and stores instead of atomic
+	 *  read-modify-write, and can still be read by other threads during a
+	 *  run. The counters of each worker are padded to keep them off the
+	 *  cache lines of other workers.
+	 */
+	class WorkerCounters
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		WorkerCounters();
+
+		/** Record count evaluations that took nanoseconds together */
+		void addEvaluations( unsigned count, uint64_t nanoseconds ) {
+			add(evaluations, count);
+			add(evaluationNanoseconds, nanoseconds);
+			add(histogram[bucket(nanoseconds/count)], count);
+		};
+		void addChunk( bool stolen ) {add(chunks, 1); if (stolen) add(steals, 1);};
+		void addTimeouts( unsigned count ) {add(timeouts, count);};
+		void addSpeculation() {add(speculations, 1);};
+		void addCutoffs( unsigned count ) {add(cutoffs, count);};
+		void addFetch( uint64_t nanoseconds ) {add(fetchNanoseconds, nanoseconds);};
+		void addLock( uint64_t nanoseconds ) {add(lockNanoseconds, nanoseconds);};
+		void addIdle( uint64_t nanoseconds ) {add(idleNanoseconds, nanoseconds);};
+
+		/** Copy the counters, may be called from any thread */
+		void snapshot( WorkerStatistics &statistics ) const;
+		/** Evaluations so far, cheaper than a full snapshot() */
+		uint64_t getEvaluations() const {return evaluations.load(std::memory_order_relaxed);};
+		uint64_t getEvaluationNanoseconds() const {return evaluationNanoseconds.load(std::memory_order_relaxed);};
+
+		/** Nanoseconds since started */
+		static uint64_t since( Clock::time_point started ) {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count();
+		};
+
+	private:
+		static void add( std::atomic<uint64_t> &counter, uint64_t value ) {
+			counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		};
+		static unsigned bucket( uint64_t nanoseconds ) {
+			unsigned b = 63 - __builtin_clzll(nanoseconds | 1);
+			return b < LatencyBuckets ? b : LatencyBuckets-1;
+		};
+
+		std::atomic<uint64_t> evaluations;
+		std::atomic<uint64_t> chunks;
+		std::atomic<uint64_t> steals;
+		std::atomic<uint64_t> timeouts;
+		std::atomic<uint64_t> speculations;
+		std::atomic<uint64_t> cutoffs;
+		std::atomic<uint64_t> evaluationNanoseconds;
+		std::atomic<uint64_t> fetchNanoseconds;
+		std::atomic<uint64_t> lockNanoseconds;
+		std::atomic<uint64_t> idleNanoseconds;
+		std::atomic<uint64_t> histogram[LatencyBuckets];
+		char padding[CacheLineSize];
+	};
+}
+
+#endif /* WORKERCOUNTERS_H_ */
@@ -0,0 +1,169 @@
+/*
+ * Affinity.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "Optimizer/Affinity.h"
+
+
+namespace
+{
+	/** Flags of get_mempolicy, from linux/mempolicy.h */
+	const unsigned long MPOL_F_NODE_ = 1;
+	const unsigned long MPOL_F_ADDR_ = 2;
+
+	/** Parse a sysfs cpu list such as "0-3,8-11" */
+	std::vector<unsigned> parseCpuList( const std::string &list )
+	{
+		std::vector<unsigned> cpus;
+		std::stringstream stream(list);
+		std::string range;
+		while (std::getline(stream, range, ',')) {
+			if (range.empty() || range[0] < '0' || range[0] > '9')
+				continue;
+			unsigned first = 0, last = 0;
+			char dash;
+			std::stringstream parts(range);
+			parts >> first;
+			if (!(parts >> dash >> last))
+				last = first;
+			for (unsigned cpu=first; cpu<=last; ++cpu)
+				cpus.push_back(cpu);
+		}
+		return cpus;
+	}
+}
+
+PAO::CpuTopology::CpuTopology()
+{
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+		for (unsigned cpu=0; cpu<CPU_SETSIZE; ++cpu)
+			if (CPU_ISSET(cpu, &mask))
+				allowed.push_back(cpu);
+	}
+	if (allowed.empty()) {
+		for (unsigned cpu=0; cpu<std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+			allowed.push_back(cpu);
+	}
+
+	for (unsigned node=0; ; ++node) {
+		std::stringstream filename;
+		filename << "/sys/devices/system/node/node"<<node<<"/cpulist";
+		std::ifstream file(filename.str().c_str());
+		if (!file.is_open())
+			break;
+		std::string list;
+		std::getline(file, list);
+
+		std::vector<unsigned> usable;
+		std::vector<unsigned> cpus = parseCpuList(list);
+		for (unsigned i=0; i<cpus.size(); ++i)
+			if (std::find(allowed.begin(), allowed.end(), cpus[i]) != allowed.end())
+				usable.push_back(cpus[i]);
+		nodes.push_back(usable);
+	}
+
+	// Without NUMA information all cpus form one node
+	bool any = false;
+	for (unsigned n=0; n<nodes.size(); ++n)
+		any = any || !nodes[n].empty();
+	if (!any) {
+		nodes.clear();
+		nodes.push_back(allowed);
+	}
+}
+
+std::vector<int> PAO::CpuTopology::assign( AffinityPolicy_t policy, unsigned workers,
+		const std::vector<unsigned> &cpus ) const
+{
+	std::vector<int> assigned(workers, -1);
+	std::vector< std::vector<unsigned> > used;
+	for (unsigned n=0; n<nodes.size(); ++n)
+		if (!nodes[n].empty())
+			used.push_back(nodes[n]);
+
+	switch (policy) {
+	case NoAffinity:
+		break;
+	case CompactAffinity: {
+		std::vector<unsigned> order;
+		for (unsigned n=0; n<used.size(); ++n)
+			order.insert(order.end(), used[n].begin(), used[n].end());
+		for (unsigned i=0; i<workers; ++i)
+			assigned[i] = order[i % order.size()];
+		break;
+	}
+	case ScatterAffinity: {
+		// Worker i gets the (i/nodes):th cpu of node i%nodes
+		std::vector<unsigned> order;
+		unsigned widest = 0;
+		for (unsigned n=0; n<used.size(); ++n)
+			widest = std::max(widest, (unsigned)used[n].size());
+		for (unsigned c=0; c<widest; ++c)
+			for (unsigned n=0; n<used.size(); ++n)
+				if (c < used[n].size())
+					order.push_back(used[n][c]);
+		for (unsigned i=0; i<workers; ++i)
+			assigned[i] = order[i % order.size()];
+		break;
+	}
+	case ExplicitAffinity:
+		if (!cpus.empty())
+			for (unsigned i=0; i<workers; ++i)
+				assigned[i] = cpus[i % cpus.size()];
+		break;
+	}
+	return assigned;
+}
+
+int PAO::CpuTopology::nodeOfCpu( int cpu ) const
+{
+	for (unsigned n=0; n<nodes.size(); ++n)
+		if (std::find(nodes[n].begin(), nodes[n].end(), (unsigned)cpu) != nodes[n].end())
+			return n;
+	return -1;
+}
+
+bool PAO::pinCurrentThread( int cpu )
+{
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	if (cpu < 0) {
+		CpuTopology topology;
+		for (unsigned i=0; i<topology.allowed.size(); ++i)
+			CPU_SET(topology.allowed[i], &mask);
+	}
+	else if (cpu < CPU_SETSIZE)
+		CPU_SET(cpu, &mask);
+	else
+		return false;
+	return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+}
+
+int PAO::nodeOfAddress( const void* address )
+{
+	int node = -1;
+	if (syscall(SYS_get_mempolicy, &node, (unsigned long*)0, 0UL, address, MPOL_F_NODE_|MPOL_F_ADDR_) != 0)
+		return -1;
+	return node;
+}
+
+int PAO::currentNode()
+{
+	unsigned cpu = 0, node = 0;
+	if (syscall(SYS_getcpu, &cpu, &node, (void*)0) != 0)
+		return -1;
+	return node;
+}
@@ -0,0 +1,588 @@
+/*
+ * CMAESOptimization.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#include "Optimizer/CMAESOptimization.h"
+#include "Optimizer/Random.h"
+
+
+namespace
+{
+	const double Pi = 3.14159265358979323846;
+
+	/** Fill z with n standard normal numbers, two per pair of uniform numbers */
+	void fillNormal( PAO::RandomStream &random, double* z, unsigned n )
+	{
+		for (unsigned j=0; j<n; j+=2) {
+			double r = std::sqrt(-2*std::log(1-random.uniform()));
+			double angle = 2*Pi*random.uniform();
+			z[j] = r*std::cos(angle);
+			if (j+1 < n)
+				z[j+1] = r*std::sin(angle);
+		}
+	}
+}
+
+/*****************************************************************
+ *
+ * 					SymmetricEigensolver
+ *
+ *****************************************************************/
+
+PAO::SymmetricEigensolver::SymmetricEigensolver()
+{
+	n = 0;
+	stride = 0;
+	started = false;
+	pending = false;
+	busy = false;
+	stop = false;
+}
+
+PAO::SymmetricEigensolver::~SymmetricEigensolver()
+{
+	if (thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		changed.notify_all();
+		thread.join();
+	}
+}
+
+void PAO::SymmetricEigensolver::start( const double* a, unsigned n, unsigned stride )
+{
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		vectors.resize(n*stride);
+		memcpy(vectors.data(), a, (size_t)n*stride*sizeof(double));
+		values.resize(n);
+		offDiagonal.resize(n);
+		this->n = n;
+		this->stride = stride;
+		pending = true;
+		started = true;
+	}
+	changed.notify_all();
+
+	if (!thread.joinable())
+		thread = std::thread(&SymmetricEigensolver::run, this);
+}
+
+void PAO::SymmetricEigensolver::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this] {return !pending && !busy;});
+	started = false;
+}
+
+void PAO::SymmetricEigensolver::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		changed.wait(lock, [this] {return pending || stop;});
+		if (!pending)
+			return;
+
+		pending = false;
+		busy = true;
+		lock.unlock();
+
+		decompose(vectors.data(), n, stride, values.data(), offDiagonal.data());
+
+		lock.lock();
+		busy = false;
+		changed.notify_all();
+	}
+}
+
+void PAO::SymmetricEigensolver::decompose( double* v, unsigned n, unsigned stride, double* d, double* e )
+{
+	#define V(i,j) v[(size_t)(i)*stride + (j)]
+	if (n == 0)
+		return;
+
+	// Householder reduction to tridiagonal form, after tred2 of EISPACK
+	for (unsigned j=0; j<n; ++j)
+		d[j] = V(n-1,j);
+
+	for (unsigned i=n-1; i>0; --i) {
+		double scale = 0, h = 0;
+		for (unsigned k=0; k<i; ++k)
+			scale += std::fabs(d[k]);
+
+		if (scale == 0) {
+			e[i] = d[i-1];
+			for (unsigned j=0; j<i; ++j) {
+				d[j] = V(i-1,j);
+				V(i,j) = 0;
+				V(j,i) = 0;
+			}
+		}
+		else {
+			for (unsigned k=0; k<i; ++k) {
+				d[k] /= scale;
+				h += d[k]*d[k];
+			}
+			double f = d[i-1];
+			double g = std::sqrt(h);
+			if (f > 0)
+				g = -g;
+			e[i] = scale*g;
+			h -= f*g;
+			d[i-1] = f-g;
+			for (unsigned j=0; j<i; ++j)
+				e[j] = 0;
+
+			for (unsigned j=0; j<i; ++j) {
+				f = d[j];
+				V(j,i) = f;
+				g = e[j] + V(j,j)*f;
+				for (unsigned k=j+1; k<i; ++k) {
+					g += V(k,j)*d[k];
+					e[k] += V(k,j)*f;
+				}
+				e[j] = g;
+			}
+			f = 0;
+			for (unsigned j=0; j<i; ++j) {
+				e[j] /= h;
+				f += e[j]*d[j];
+			}
+			double hh = f/(h+h);
+			for (unsigned j=0; j<i; ++j)
+				e[j] -= hh*d[j];
+			for (unsigned j=0; j<i; ++j) {
+				f = d[j];
+				g = e[j];
+				for (unsigned k=j; k<i; ++k)
+					V(k,j) -= f*e[k] + g*d[k];
+				d[j] = V(i-1,j);
+				V(i,j) = 0;
+			}
+		}
+		d[i] = h;
+	}
+
+	// Accumulate the transformations
+	for (unsigned i=0; i+1<n; ++i) {
+		V(n-1,i) = V(i,i);
+		V(i,i) = 1;
+		double h = d[i+1];
+		if (h != 0) {
+			for (unsigned k=0; k<=i; ++k)
+				d[k] = V(k,i+1)/h;
+			for (unsigned j=0; j<=i; ++j) {
+				double g = 0;
+				for (unsigned k=0; k<=i; ++k)
+					g += V(k,i+1)*V(k,j);
+				for (unsigned k=0; k<=i; ++k)
+					V(k,j) -= g*d[k];
+			}
+		}
+		for (unsigned k=0; k<=i; ++k)
+			V(k,i+1) = 0;
+	}
+	for (unsigned j=0; j<n; ++j) {
+		d[j] = V(n-1,j);
+		V(n-1,j) = 0;
+	}
+	V(n-1,n-1) = 1;
+	e[0] = 0;
+
+	// Implicit QL iterations on the tridiagonal matrix, after tql2 of EISPACK
+	for (unsigned i=1; i<n; ++i)
+		e[i-1] = e[i];
+	e[n-1] = 0;
+
+	double f = 0, largest = 0;
+	const double eps = std::numeric_limits<double>::epsilon();
+	for (unsigned l=0; l<n; ++l) {
+		largest = std::max(largest, std::fabs(d[l]) + std::fabs(e[l]));
+		unsigned m = l;
+		while (m < n-1 && std::fabs(e[m]) > eps*largest)
+			++m;
+
+		if (m > l) {
+			do {
+				double g = d[l];
+				double p = (d[l+1]-g)/(2*e[l]);
+				double r = std::hypot(p, 1.0);
+				if (p < 0)
+					r = -r;
+				d[l] = e[l]/(p+r);
+				d[l+1] = e[l]*(p+r);
+				double dl1 = d[l+1];
+				double h = g - d[l];
+				for (unsigned i=l+2; i<n; ++i)
+					d[i] -= h;
+				f += h;
+
+				p = d[m];
+				double c = 1, c2 = 1, c3 = 1;
+				double el1 = e[l+1];
+				double s = 0, s2 = 0;
+				for (unsigned i=m; i-->l; ) {
+					c3 = c2;
+					c2 = c;
+					s2 = s;
+					g = c*e[i];
+					h = c*p;
+					r = std::hypot(p, e[i]);
+					e[i+1] = s*r;
+					s = e[i]/r;
+					c = p/r;
+					p = c*d[i] - s*g;
+					d[i+1] = h + s*(c*g + s*d[i]);
+					for (unsigned k=0; k<n; ++k) {
+						h = V(k,i+1);
+						V(k,i+1) = s*V(k,i) + c*h;
+						V(k,i) = c*V(k,i) - s*h;
+					}
+				}
+				p = -s*s2*c3*el1*e[l]/dl1;
+				e[l] = s*p;
+				d[l] = c*p;
+			} while (std::fabs(e[l]) > eps*largest);
+		}
+		d[l] += f;
+		e[l] = 0;
+	}
+	#undef V
+}
+
+/*****************************************************************
+ *
+ * 					CMAESOptimizer
+ *
+ *****************************************************************/
+
+PAO::CMAESOptimizer::CMAESOptimizer( std::vector<OptimizationWorker*> workers, CMAESParameters parameters )
+ : MasterOptimizer( workers )
+{
+	cmaes = parameters;
+	n = 0;
+	stride = 0;
+	lambda = 0;
+	mu = 0;
+	generation = 0;
+	generations = 0;
+	restart = 0;
+}
+
+PAO::CMAESOptimizer::~CMAESOptimizer()
+{
+}
+
+double PAO::CMAESOptimizer::optimize()
+{
+	n = paramBounds->size();
+	const unsigned lanes = ArrayAlignment/sizeof(double);
+	stride = (n+lanes-1)/lanes*lanes;
+
+	double population = cmaes.population > 0 ? cmaes.population : 4 + std::floor(3*std::log((double)n));
+
+	std::cout << "Optimizing " << n << " dimensions"<<std::endl;
+	std::cout << "Starting CMA-ES with "<<(unsigned)population<<" candidates per generation and up to "
+			<<cmaes.restarts<<" restarts"<<std::endl;
+	std::cout << "Using seed "<<seed<<std::endl;
+
+	bestParameters.fitnessValue = std::numeric_limits<double>::max();
+	scratch.resize(stride*workers.size());
+	generations = 0;
+	resetUtilization();
+	resetStopping();
+
+	for (restart=0; ; ++restart) {
+		if (restart > 0)
+			std::cout << "Restarting with "<<(unsigned)population<<" candidates per generation"<<std::endl;
+		startRun( (unsigned)population );
+		if (!runGenerations() || restart == cmaes.restarts)
+			break;
+		population *= cmaes.populationIncrease;
+	}
+
+	if (eigensolver.isStarted())
+		eigensolver.wait();
+	if (isStopping())
+		std::cout << "Stopped early: "<<getStopReasonName(stopReason)<<std::endl;
+	std::cout << "Worker utilization: "<<getUtilization()*100<<"%"<<std::endl;
+	WorkerStatistics total = getTotalStatistics();
+	std::cout << "Worker time: "<<total.evaluationSeconds<<" s evaluating, "<<total.fetchSeconds<<" s fetching work, ";
+	std::cout << total.lockSeconds<<" s waiting for locks, "<<total.idleSeconds<<" s idle, in "<<total.chunks<<" chunks"<<std::endl;
+
+	return bestParameters.fitnessValue;
+}
+
+void PAO::CMAESOptimizer::startRun( unsigned population )
+{
+	// Default strategy parameters, see Hansen's CMA-ES tutorial
+	lambda = std::max(2u, population);
+	mu = lambda/2;
+	weights.resize(mu);
+	double sum = 0, squares = 0;
+	for (unsigned i=0; i<mu; ++i) {
+		weights[i] = std::log(mu+0.5) - std::log(i+1.0);
+		sum += weights[i];
+	}
+	for (unsigned i=0; i<mu; ++i) {
+		weights[i] /= sum;
+		squares += weights[i]*weights[i];
+	}
+	mueff = 1/squares;
+
+	cc = (4 + mueff/n)/(n + 4 + 2*mueff/n);
+	cs = (mueff + 2)/(n + mueff + 5);
+	c1 = 2/((n+1.3)*(n+1.3) + mueff);
+	cmu = std::min(1-c1, 2*(mueff - 2 + 1/mueff)/((n+2.0)*(n+2.0) + mueff));
+	damps = 1 + 2*std::max(0.0, std::sqrt((mueff-1)/(n+1)) - 1) + cs;
+	chiN = std::sqrt((double)n)*(1 - 1/(4.0*n) + 1/(21.0*n*n));
+	decompositionInterval = std::max(1u, (unsigned)(1/((c1+cmu)*n*10)));
+
+	// Every run starts at a random mean drawn from a stream of its own
+	RandomStream random(seed, ((uint64_t)restart<<32) | 0xFFFFFFFF, 0);
+	mean.resize(n);
+	for (unsigned i=0; i<n; ++i)
+		mean[i] = random.uniform();
+	sigma = cmaes.sigma;
+	pc.assign(n, 0);
+	ps.assign(n, 0);
+	D.assign(n, 1);
+	C.resize(n*stride);
+	B.resize(n*stride);
+	C.fill(0);
+	B.fill(0);
+	for (unsigned i=0; i<n; ++i) {
+		C[i*stride+i] = 1;
+		B[i*stride+i] = 1;
+	}
+
+	candidates.resize(lambda*stride);
+	steps.resize(lambda*stride);
+	fitness.resize(lambda);
+	order.resize(lambda);
+	selected.resize(std::max(1u, mu)*stride);
+	selected.fill(0);
+	meanStep.resize(n);
+	whitened.resize(n);
+	history.assign(10 + (unsigned)std::ceil(30.0*n/lambda), 0);
+
+	// A decomposition of the previous run is of no use
+	if (eigensolver.isStarted())
+		eigensolver.wait();
+	lastDecomposition = 0;
+	generation = 0;
+}
+
+bool PAO::CMAESOptimizer::runGenerations()
+{
+	unsigned threads = workers.size();
+	unsigned maxGenerations = cmaes.generations > 0 ? cmaes.generations :
+			100 + (unsigned)(150.0*(n+3)*(n+3)/std::sqrt((double)lambda));
+	unsigned partition = std::max(1u, lambda/(4*threads));
+	unsigned rows = std::max(1u, n/(4*threads));
+
+	while (generation < maxGenerations) {
+		parallelFor(lambda, partition, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+			sampleCandidates(worker, begin, end); });
+
+		evaluate( candidates.data(), stride, lambda, fitness.data() );
+
+		// Ties go to the lowest index so the result does not depend on the workers
+		for (unsigned k=0; k<lambda; ++k)
+			order[k] = k;
+		std::sort(order.begin(), order.end(), [this](unsigned a, unsigned b) {
+			return fitness[a] < fitness[b] || (fitness[a] == fitness[b] && a < b); });
+
+		double best = fitness[order[0]];
+		if (best < bestParameters.fitnessValue) {
+			bestParameters.parameters.assign(candidate(order[0]), candidate(order[0])+n);
+			bestParameters.fitnessValue = best;
+			if (callbackFoundNewMinimum!=0)
+				callbackFoundNewMinimum(best, (restart + generation/(double)maxGenerations)/(cmaes.restarts+1));
+		}
+		if (isStopping())
+			return false;
+
+		// Move the mean to the weighted mean of the best steps
+		for (unsigned i=0; i<n; ++i)
+			meanStep[i] = 0;
+		for (unsigned k=0; k<mu; ++k) {
+			const double* y = step(order[k]);
+			for (unsigned i=0; i<n; ++i)
+				meanStep[i] += weights[k]*y[i];
+		}
+		for (unsigned i=0; i<n; ++i)
+			mean[i] += sigma*meanStep[i];
+
+		// whitened = B*D^-1*B^T*meanStep, using the first scratch row as no job is running
+		double* rotated = scratch.data();
+		for (unsigned j=0; j<n; ++j)
+			rotated[j] = 0;
+		for (unsigned i=0; i<n; ++i) {
+			const double* b = &B[i*stride];
+			for (unsigned j=0; j<n; ++j)
+				rotated[j] += b[j]*meanStep[i];
+		}
+		for (unsigned j=0; j<n; ++j)
+			rotated[j] /= D[j];
+		for (unsigned i=0; i<n; ++i) {
+			const double* b = &B[i*stride];
+			double sum = 0;
+			for (unsigned j=0; j<n; ++j)
+				sum += b[j]*rotated[j];
+			whitened[i] = sum;
+		}
+
+		// Evolution paths
+		double psNorm = 0;
+		double psFactor = std::sqrt(cs*(2-cs)*mueff);
+		for (unsigned i=0; i<n; ++i) {
+			ps[i] = (1-cs)*ps[i] + psFactor*whitened[i];
+			psNorm += ps[i]*ps[i];
+		}
+		psNorm = std::sqrt(psNorm);
+		bool hsig = psNorm/std::sqrt(1 - std::pow(1-cs, 2.0*(generation+1)))/chiN < 1.4 + 2/(n+1.0);
+		double pcFactor = hsig ? std::sqrt(cc*(2-cc)*mueff) : 0;
+		for (unsigned i=0; i<n; ++i)
+			pc[i] = (1-cc)*pc[i] + pcFactor*meanStep[i];
+
+		// Rank-one and rank-mu update, each worker taking a block of rows.
+		// Scaling the selected steps by sqrt(cmu*weight) makes the rank-mu
+		// part a plain sum of outer products.
+		for (unsigned k=0; k<mu; ++k) {
+			const double* y = step(order[k]);
+			double* s = &selected[k*stride];
+			double scale = std::sqrt(cmu*weights[k]);
+			for (unsigned i=0; i<n; ++i)
+				s[i] = scale*y[i];
+		}
+		covarianceDecay = 1 - c1 - cmu + (hsig ? 0 : c1*cc*(2-cc));
+		parallelFor(n, rows, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+			updateCovariance(worker, begin, end); });
+
+		sigma *= std::exp((cs/damps)*(psNorm/chiN - 1));
+
+		// Escape a flat fitness landscape with a larger step
+		unsigned flat = std::min(lambda-1, (unsigned)std::ceil(0.1 + lambda/4.0));
+		if (fitness[order[0]] == fitness[order[flat]])
+			sigma *= std::exp(0.2 + cs/damps);
+
+		history[generation % history.size()] = best;
+		++generation;
+		++generations;
+
+		// The decomposition started after the previous generation has had this
+		// generation's evaluations to finish. The next one overlaps with the next.
+		if (eigensolver.isStarted())
+			adoptDecomposition();
+		if (generation - lastDecomposition >= decompositionInterval) {
+			eigensolver.start(C.data(), n, stride);
+			lastDecomposition = generation;
+		}
+
+		if (callbackGeneration != 0)
+			callbackGeneration(generations, bestParameters.fitnessValue);
+		if (checkGeneration(generations, bestParameters.fitnessValue,
+				wantsDiversity() ? diversity(candidates.data(), stride, lambda) : -1))
+			return false;
+
+		if (hasConverged())
+			return true;
+	}
+	return true;
+}
+
+void PAO::CMAESOptimizer::sampleCandidates( OptimizationWorker* worker, unsigned begin, unsigned end )
+{
+	double* z = scratch.data() + stride*worker->getIndex();
+	const std::vector<double> &lower = paramBounds->min;
+	const std::vector<double> &upper = paramBounds->max;
+
+	for (unsigned k=begin; k<end; ++k) {
+		// Each candidate has its own stream, with a substream per generation
+		RandomStream random(seed, ((uint64_t)restart<<32) | k, generations+1);
+		fillNormal(random, z, n);
+		for (unsigned j=0; j<n; ++j)
+			z[j] *= D[j];
+
+		double* y = step(k);
+		double* x = candidate(k);
+		for (unsigned i=0; i<n; ++i) {
+			const double* b = &B[i*stride];
+			double sum = 0;
+			for (unsigned j=0; j<n; ++j)
+				sum += b[j]*z[j];
+
+			// Candidates outside the bounds are moved onto them
+			double scaled = std::min(1.0, std::max(0.0, mean[i] + sigma*sum));
+			y[i] = (scaled - mean[i])/sigma;
+			x[i] = lower[i] + scaled*(upper[i]-lower[i]);
+		}
+		for (unsigned i=n; i<stride; ++i) {
+			y[i] = 0;
+			x[i] = 0;
+		}
+	}
+}
+
+void PAO::CMAESOptimizer::updateCovariance( OptimizationWorker* worker, unsigned begin, unsigned end )
+{
+	for (unsigned j=begin; j<end; ++j) {
+		double* row = &C[j*stride];
+		double a = c1*pc[j];
+		for (unsigned k=0; k<n; ++k)
+			row[k] = covarianceDecay*row[k] + a*pc[k];
+
+		for (unsigned i=0; i<mu; ++i) {
+			const double* s = &selected[i*stride];
+			double b = s[j];
+			for (unsigned k=0; k<n; ++k)
+				row[k] += b*s[k];
+		}
+	}
+}
+
+void PAO::CMAESOptimizer::adoptDecomposition()
+{
+	eigensolver.wait();
+	const double* values = eigensolver.eigenvalues();
+	const double* vectors = eigensolver.eigenvectors();
+	memcpy(B.data(), vectors, (size_t)n*stride*sizeof(double));
+	// Rounding may leave eigenvalues of a badly conditioned matrix negative,
+	// hasConverged() then restarts the run on its condition number
+	for (unsigned j=0; j<n; ++j)
+		D[j] = std::sqrt(std::max(values[j], std::numeric_limits<double>::min()));
+}
+
+bool PAO::CMAESOptimizer::hasConverged()
+{
+	// Best fitness-values of recent generations and all current ones are within tolFun
+	if (generation >= history.size()) {
+		double low = *std::min_element(history.begin(), history.end());
+		double high = *std::max_element(history.begin(), history.end());
+		if (high - low < cmaes.tolFun && fitness[order[lambda-1]] - fitness[order[0]] < cmaes.tolFun)
+			return true;
+	}
+
+	// The step in every direction is below tolX
+	bool small = true;
+	for (unsigned i=0; i<n && small; ++i)
+		small = sigma*std::max(std::fabs(pc[i]), std::sqrt(C[i*stride+i])) < cmaes.tolX;
+	if (small)
+		return true;
+
+	double low = *std::min_element(D.begin(), D.end());
+	double high = *std::max_element(D.begin(), D.end());
+	return high*high > cmaes.maxCondition*low*low;
+}
@@ -0,0 +1,187 @@
+/*
+ * Checkpoint.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <iostream>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Optimizer/Checkpoint.h"
+
+
+#ifndef ERROR
+	/** Macro generates coloured output with file and line number */
+	#define WARN(TO_COUT)  {std::string strfile(__FILE__);\
+		strfile = strfile.substr(strfile.rfind('/')+1, std::string::npos);\
+		std::cout<<"\e[0;33mWarning: "<<strfile<<":"<<__LINE__<<" - "<<	TO_COUT << "\e[0m" << std::endl<<std::flush;}
+
+	#define ERROR(TO_COUT)  {std::string strfile(__FILE__);\
+		strfile = strfile.substr(strfile.rfind('/')+1, std::string::npos);\
+		std::cout<<"\e[0;31mERROR: "<<strfile<<":"<<__LINE__<<" - "<<	TO_COUT << "\e[0m" << std::endl<<std::flush;\
+		abort();}
+#endif
+
+
+namespace
+{
+	/** Write data to filename through a temporary file. Returns false on failure. */
+	bool writeAtomically( const std::string &filename, const std::vector<char> &data )
+	{
+		std::string temporary = filename + ".tmp";
+		int fd = open(temporary.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+		if (fd < 0)
+			return false;
+
+		// error keeps the errno of the first failure for the caller
+		const char* p = data.data();
+		size_t left = data.size();
+		int error = 0;
+		while (left > 0) {
+			ssize_t written = write(fd, p, left);
+			if (written < 0 && errno == EINTR)
+				continue;
+			if (written <= 0) {
+				error = written < 0 ? errno : ENOSPC;
+				break;
+			}
+			p += written;
+			left -= written;
+		}
+
+		// The data must be on disk before the rename makes it the checkpoint
+		if (error == 0 && fsync(fd) != 0)
+			error = errno;
+		if (close(fd) != 0 && error == 0)
+			error = errno;
+		if (error == 0 && rename(temporary.c_str(), filename.c_str()) != 0)
+			error = errno;
+		if (error != 0) {
+			unlink(temporary.c_str());
+			errno = error;
+			return false;
+		}
+
+		// The rename is only durable once the directory is on disk as well
+		size_t slash = filename.rfind('/');
+		std::string directory = (slash == std::string::npos) ? "." : filename.substr(0, std::max<size_t>(slash, 1));
+		int dirfd = open(directory.c_str(), O_RDONLY|O_DIRECTORY);
+		if (dirfd < 0)
+			return false;
+		if (fsync(dirfd) != 0)
+			error = errno;
+		close(dirfd);
+		errno = error;
+		return error == 0;
+	}
+}
+
+/*****************************************************************
+ *
+ * 					Class CheckpointWriter
+ *
+ *****************************************************************/
+
+PAO::CheckpointWriter::CheckpointWriter()
+{
+	hasPending = false;
+	busy = false;
+	stop = false;
+}
+
+PAO::CheckpointWriter::~CheckpointWriter()
+{
+	if (thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		changed.notify_all();
+		thread.join();
+	}
+}
+
+void PAO::CheckpointWriter::commit( const std::string &filename )
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (hasPending)
+			WARN("Skipping checkpoint, the disk is slower than the optimizer");
+		filling.swap(pending);
+		pendingFile = filename;
+		hasPending = true;
+	}
+	changed.notify_all();
+
+	if (!thread.joinable())
+		thread = std::thread(&CheckpointWriter::run, this);
+}
+
+void PAO::CheckpointWriter::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this] {return !hasPending && !busy;});
+}
+
+void PAO::CheckpointWriter::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		// Pending snapshots are written before stopping
+		changed.wait(lock, [this] {return hasPending || stop;});
+		if (!hasPending)
+			return;
+
+		writing.swap(pending);
+		std::string filename = pendingFile;
+		hasPending = false;
+		busy = true;
+		lock.unlock();
+
+		if (!writeAtomically(filename, writing))
+			WARN("Could not write checkpoint "<<filename<<": "<<strerror(errno));
+
+		lock.lock();
+		busy = false;
+		changed.notify_all();
+	}
+}
+
+/*****************************************************************
+ *
+ * 					Class MappedFile
+ *
+ *****************************************************************/
+
+PAO::MappedFile::MappedFile( const std::string &filename )
+{
+	data = 0;
+	length = 0;
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+
+	struct stat status;
+	if (fstat(fd, &status) == 0 && status.st_size > 0) {
+		void* mapping = mmap(0, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping != MAP_FAILED) {
+			data = (const char*)mapping;
+			length = status.st_size;
+		}
+	}
+	close(fd);
+}
+
+PAO::MappedFile::~MappedFile()
+{
+	if (data != 0)
+		munmap((void*)data, length);
+}
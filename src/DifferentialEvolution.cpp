@@ -0,0 +1,300 @@
+/*
+ * DifferentialEvolution.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#include "Optimizer/DifferentialEvolution.h"
+#include "Optimizer/Random.h"
+
+
+namespace
+{
+	/** Individuals per BlockResult. Fixed so that the sums merged by
+	 *  mergeBlocks() do not depend on how work is divided among workers. */
+	const unsigned SelectionBlock = 64;
+
+	const double Pi = 3.14159265358979323846;
+}
+
+PAO::DifferentialEvolutionOptimizer::DifferentialEvolutionOptimizer(
+		std::vector<OptimizationWorker*> workers, DEParameters parameters )
+ : MasterOptimizer( workers )
+{
+	de = parameters;
+	n = 0;
+	stride = 0;
+	size = 0;
+	generation = 0;
+	pbestCount = 1;
+	topCount = 1;
+	meanF = de.F;
+	meanCR = de.CR;
+}
+
+PAO::DifferentialEvolutionOptimizer::~DifferentialEvolutionOptimizer()
+{
+}
+
+double PAO::DifferentialEvolutionOptimizer::optimize()
+{
+	unsigned threads = workers.size();
+	n = paramBounds->size();
+	const unsigned lanes = ArrayAlignment/sizeof(double);
+	stride = (n+lanes-1)/lanes*lanes;
+	size = std::max(4u, de.populationSize);
+
+	std::cout << "Optimizing " << n << " dimensions"<<std::endl;
+	std::cout << "Starting DE with "<<size<<" individuals and "<<de.generations<<" generations.\n";
+	switch (de.variant) {
+	case RandOneBinomial:
+		std::cout << "Using rand/1/bin with F="<<de.F<<", CR="<<de.CR<<std::endl;
+		break;
+	case CurrentToPBest:
+		std::cout << "Using current-to-pbest/1/bin with p="<<de.p<<" and adaptive F and CR"<<std::endl;
+		break;
+	}
+	std::cout << "Using seed "<<seed<<std::endl;
+
+	bestParameters.fitnessValue = std::numeric_limits<double>::max();
+	population.resize(size*stride);
+	fitness.resize(size);
+	trials.resize(size*stride);
+	trialFitness.resize(size);
+	trialF.resize(size);
+	trialCR.resize(size);
+	archive.resize(size*stride);
+	archiveValid.assign(size, 0);
+	ranking.resize(size);
+	blocks.resize((size+SelectionBlock-1)/SelectionBlock);
+	pbestCount = std::min(size, std::max(1u, (unsigned)std::lround(de.p*size)));
+	topCount = de.variant == CurrentToPBest ? std::min(pbestCount, SelectionBlock) : 1;
+	blockTop.resize(blocks.size()*topCount);
+	meanF = de.F;
+	meanCR = de.CR;
+	resetUtilization();
+	resetStopping();
+
+	// Work is split in a few partitions per worker so that stealing can even out the load
+	unsigned partition = std::max(1u, size/(4*threads));
+	unsigned blockPartition = std::max(1u, (unsigned)blocks.size()/(4*threads));
+
+	// Every worker first touches the share of individuals it starts each job with
+	parallelFor(size, 1, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+		initializeIndividuals(worker, begin, end); }, StaticSchedule);
+	evaluate( population.data(), stride, size, fitness.data() );
+
+	// There are no trials yet, so the blocks are only ranked. Selecting against
+	// empty trials would take them for better than parents that are not finite.
+	parallelFor(blocks.size(), blockPartition, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+		for (unsigned k=begin; k<end; ++k) {
+			blocks[k] = BlockResult();
+			rankBlock(k);
+		} });
+	mergeBlocks(0);
+
+	for (generation=0; generation<de.generations && !isStopping(); ++generation) {
+		parallelFor(size, partition, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+			createTrials(worker, begin, end); });
+
+		// A trial is only of use if it is better than its parent
+		evaluate( trials.data(), stride, size, trialFitness.data(), fitness.data() );
+
+		parallelFor(blocks.size(), blockPartition, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+			selectBlocks(worker, begin, end); });
+		mergeBlocks( (generation+1)/(double)de.generations );
+
+		if (callbackGeneration != 0)
+			callbackGeneration(generation+1, bestParameters.fitnessValue);
+
+		if (checkGeneration(generation+1, bestParameters.fitnessValue,
+				wantsDiversity() ? diversity(population.data(), stride, size) : -1))
+			break;
+	}
+
+	if (isStopping())
+		std::cout << "Stopped early: "<<getStopReasonName(stopReason)<<std::endl;
+	std::cout << "Worker utilization: "<<getUtilization()*100<<"%"<<std::endl;
+	WorkerStatistics total = getTotalStatistics();
+	std::cout << "Worker time: "<<total.evaluationSeconds<<" s evaluating, "<<total.fetchSeconds<<" s fetching work, ";
+	std::cout << total.lockSeconds<<" s waiting for locks, "<<total.idleSeconds<<" s idle, in "<<total.chunks<<" chunks"<<std::endl;
+	if (total.timeouts > 0 || total.speculations > 0 || total.cutoffs > 0)
+		std::cout << "Evaluations: "<<total.timeouts<<" timed out, "<<total.speculations<<" duplicated by idle workers, "
+				<<total.cutoffs<<" stopped at their cutoff"<<std::endl;
+
+	return bestParameters.fitnessValue;
+}
+
+void PAO::DifferentialEvolutionOptimizer::initializeIndividuals( OptimizationWorker* worker, unsigned begin, unsigned end )
+{
+	for (unsigned i=begin; i<end; ++i) {
+		// Substream 0 of each individual is used for initialization
+		RandomStream random(seed, i, 0);
+		double* x = individual(i);
+		for (unsigned j=0; j<n; ++j)
+			x[j] = random.uniform(paramBounds->min[j], paramBounds->max[j]);
+		for (unsigned j=n; j<stride; ++j)
+			x[j] = 0;
+		memset(trial(i), 0, stride*sizeof(double));
+		memset(archived(i), 0, stride*sizeof(double));
+	}
+}
+
+void PAO::DifferentialEvolutionOptimizer::createTrials( OptimizationWorker* worker, unsigned begin, unsigned end )
+{
+	const std::vector<double> &lower = paramBounds->min;
+	const std::vector<double> &upper = paramBounds->max;
+
+	for (unsigned i=begin; i<end; ++i) {
+		RandomStream random(seed, i, generation+1);
+		const double* target = individual(i);
+		double* t = trial(i);
+		double F = de.F, CR = de.CR;
+
+		// Mutant is base + F*(a-b) + F*(c-d), the second difference only for CurrentToPBest
+		const double *base, *a, *b, *c = 0, *d = 0;
+		if (de.variant == RandOneBinomial) {
+			unsigned r1, r2, r3;
+			do r1 = (unsigned)(random.uniform()*size); while (r1 == i);
+			do r2 = (unsigned)(random.uniform()*size); while (r2 == i || r2 == r1);
+			do r3 = (unsigned)(random.uniform()*size); while (r3 == i || r3 == r1 || r3 == r2);
+			base = individual(r1);
+			a = individual(r2);
+			b = individual(r3);
+		}
+		else {
+			CR = std::min(1.0, std::max(0.0, meanCR + 0.1*random.normal()));
+			do F = meanF + 0.1*std::tan(Pi*(random.uniform()-0.5)); while (F <= 0);
+			F = std::min(F, 1.0);
+
+			// The second vector of the difference may also be a replaced parent
+			unsigned pbest = ranking[(unsigned)(random.uniform()*pbestCount)];
+			unsigned r1, r2;
+			do r1 = (unsigned)(random.uniform()*size); while (r1 == i);
+			do r2 = (unsigned)(random.uniform()*2*size);
+			while (r2 < size ? (r2 == i || r2 == r1) : !archiveValid[r2-size]);
+			base = target;
+			a = individual(pbest);
+			b = target;
+			c = individual(r1);
+			d = r2 < size ? individual(r2) : archived(r2-size);
+		}
+
+		// Binomial crossover takes at least parameter jrand from the mutant.
+		// Mutants outside the bounds are moved halfway from the parent to the bound.
+		unsigned jrand = (unsigned)(random.uniform()*n);
+		for (unsigned j=0; j<n; ++j) {
+			bool cross = random.uniform() < CR;
+			if (!cross && j != jrand) {
+				t[j] = target[j];
+				continue;
+			}
+			double v = base[j] + F*(a[j]-b[j]);
+			if (c != 0)
+				v += F*(c[j]-d[j]);
+			if (v < lower[j])
+				v = (lower[j]+target[j])/2;
+			else if (v > upper[j])
+				v = (upper[j]+target[j])/2;
+			t[j] = v;
+		}
+		trialF[i] = F;
+		trialCR[i] = CR;
+	}
+}
+
+void PAO::DifferentialEvolutionOptimizer::selectBlocks( OptimizationWorker* worker, unsigned begin, unsigned end )
+{
+	for (unsigned k=begin; k<end; ++k) {
+		BlockResult &result = blocks[k];
+		result.sumF = 0;
+		result.sumF2 = 0;
+		result.sumCR = 0;
+		result.successes = 0;
+
+		unsigned last = std::min(size, (k+1)*SelectionBlock);
+		for (unsigned i=k*SelectionBlock; i<last; ++i) {
+			// Trials that reached the cutoff are lower bounds, so only strictly better ones are taken
+			if (trialFitness[i] < fitness[i]) {
+				if (de.variant == CurrentToPBest) {
+					memcpy(archived(i), individual(i), stride*sizeof(double));
+					archiveValid[i] = 1;
+					result.sumF += trialF[i];
+					result.sumF2 += trialF[i]*trialF[i];
+					result.sumCR += trialCR[i];
+					++result.successes;
+				}
+				memcpy(individual(i), trial(i), stride*sizeof(double));
+				fitness[i] = trialFitness[i];
+			}
+		}
+		rankBlock(k);
+	}
+}
+
+void PAO::DifferentialEvolutionOptimizer::rankBlock( unsigned k )
+{
+	BlockResult &result = blocks[k];
+	unsigned* top = &blockTop[(size_t)k*topCount];
+	result.ranked = 0;
+
+	// Insertion into a short sorted list, ties keep the lower index first
+	unsigned last = std::min(size, (k+1)*SelectionBlock);
+	for (unsigned i=k*SelectionBlock; i<last; ++i) {
+		if (result.ranked == topCount && !(fitness[i] < fitness[top[topCount-1]]))
+			continue;
+		unsigned pos = (result.ranked < topCount) ? result.ranked++ : topCount-1;
+		while (pos > 0 && fitness[i] < fitness[top[pos-1]]) {
+			top[pos] = top[pos-1];
+			--pos;
+		}
+		top[pos] = i;
+	}
+}
+
+void PAO::DifferentialEvolutionOptimizer::mergeBlocks( double progress )
+{
+	double sumF = 0, sumF2 = 0, sumCR = 0;
+	unsigned successes = 0;
+	unsigned best = size;
+	unsigned candidates = 0;
+	for (unsigned k=0; k<blocks.size(); ++k) {
+		sumF += blocks[k].sumF;
+		sumF2 += blocks[k].sumF2;
+		sumCR += blocks[k].sumCR;
+		successes += blocks[k].successes;
+
+		const unsigned* top = &blockTop[(size_t)k*topCount];
+		if (blocks[k].ranked > 0 && (best == size || fitness[top[0]] < fitness[best]))
+			best = top[0];
+		if (de.variant == CurrentToPBest)
+			for (unsigned j=0; j<blocks[k].ranked; ++j)
+				ranking[candidates++] = top[j];
+	}
+
+	// JADE adaptation: arithmetic mean of successful CR, Lehmer mean of successful F
+	if (de.variant == CurrentToPBest && successes > 0) {
+		meanCR = (1-de.c)*meanCR + de.c*sumCR/successes;
+		if (sumF > 0)
+			meanF = (1-de.c)*meanF + de.c*sumF2/sumF;
+	}
+
+	// The best pbestCount are among the best topCount of each block.
+	// Only the set matters, not their order.
+	if (de.variant == CurrentToPBest && candidates > pbestCount)
+		std::nth_element(ranking.begin(), ranking.begin()+pbestCount-1, ranking.begin()+candidates, [this](unsigned a, unsigned b) {
+			return fitness[a] < fitness[b] || (fitness[a] == fitness[b] && a < b); });
+
+	if (best < size && fitness[best] < bestParameters.fitnessValue) {
+		bestParameters.parameters.assign(individual(best), individual(best)+n);
+		bestParameters.fitnessValue = fitness[best];
+		if (callbackFoundNewMinimum!=0)
+			callbackFoundNewMinimum(bestParameters.fitnessValue, progress);
+	}
+}
@@ -0,0 +1,274 @@
+/*
+ * Dispatcher.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "Optimizer/Dispatcher.h"
+#include "Optimizer/WorkerCounters.h"
+
+
+PAO::Dispatcher::Dispatcher()
+{
+	workerCount = 0;
+	job = 0;
+	idle = 0;
+	policy = DynamicSchedule;
+	chunkSize = 1;
+	remaining = 0;
+	interruptible = false;
+	interrupted = false;
+	hasDeadline = false;
+	itemSeconds = 0;
+	fetchSeconds = 0;
+	jobItems = 0;
+	jobNanoseconds = 0;
+	jobFetches = 0;
+	fetchNanoseconds = 0;
+	epoch = 0;
+	busy = 0;
+}
+
+PAO::Dispatcher::~Dispatcher()
+{
+}
+
+void PAO::Dispatcher::setWorkerCount( unsigned workers )
+{
+	workerCount = workers;
+	slots.reset( new Slot[workers] );
+	counters.reset( new WorkerCounters[workers] );
+	for (unsigned i=0; i<workers; ++i)
+		slots[i].range = pack(0,0);
+}
+
+namespace
+{
+	/** Fraction of the time on items that fetching chunks may take with AdaptiveSchedule */
+	const double AdaptiveOverhead = 0.01;
+	/** Weight of the latest job in the moving averages of AdaptiveSchedule */
+	const double AdaptiveSmoothing = 0.5;
+}
+
+void PAO::Dispatcher::run( unsigned items, unsigned chunkSize, const JobFunction& job,
+		SchedulePolicy_t policy, bool interruptible, const IdleFunction* idle )
+{
+	if (items==0 || workerCount==0)
+		return;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	// Stragglers from the previous job may still be looking for work
+	jobDone.wait(lock, [&] {return busy==0;});
+
+	for (unsigned i=0; i<workerCount; ++i) {
+		unsigned begin = (uint64_t)items*i/workerCount;
+		unsigned end = (uint64_t)items*(i+1)/workerCount;
+		slots[i].range = pack(begin, end);
+	}
+	this->job = &job;
+	this->idle = idle;
+	this->policy = policy;
+	this->interruptible = interruptible;
+	this->chunkSize = std::max(1u, chunkSize);
+	if (policy == AdaptiveSchedule)
+		this->chunkSize = adaptiveChunkSize(items, this->chunkSize);
+	remaining = items;
+	jobItems = 0;
+	jobNanoseconds = 0;
+	jobFetches = 0;
+	fetchNanoseconds = 0;
+	++epoch;
+
+	jobReady.notify_all();
+	jobDone.wait(lock, [&] {
+		return ((remaining==0 || stopped()) && busy==0) ; });
+	this->job = 0;
+
+	if (policy == AdaptiveSchedule && jobItems > 0) {
+		double item = jobNanoseconds*1e-9/jobItems;
+		double fetch = jobFetches > 0 ? fetchNanoseconds*1e-9/jobFetches : 0;
+		bool first = itemSeconds == 0;
+		itemSeconds = first ? item : AdaptiveSmoothing*item + (1-AdaptiveSmoothing)*itemSeconds;
+		fetchSeconds = first ? fetch : AdaptiveSmoothing*fetch + (1-AdaptiveSmoothing)*fetchSeconds;
+	}
+}
+
+unsigned PAO::Dispatcher::adaptiveChunkSize( unsigned items, unsigned chunkSize )
+{
+	if (itemSeconds <= 0)
+		return chunkSize;
+
+	// Small enough that every worker gets a few chunks to balance the load
+	double overheadChunk = std::ceil(fetchSeconds / (AdaptiveOverhead*itemSeconds));
+	unsigned balanceChunk = std::max(1u, items/(4*workerCount));
+	return std::max(chunkSize, (unsigned)std::min<double>(overheadChunk, balanceChunk));
+}
+
+bool PAO::Dispatcher::waitForJob( unsigned &seenEpoch, const std::atomic<bool> &stop )
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	jobReady.wait(lock, [&] {
+		return (epoch!=seenEpoch || stop) ; });
+	if (stop)
+		return false;
+
+	seenEpoch = epoch;
+	++busy;
+	return true;
+}
+
+void PAO::Dispatcher::work( unsigned workerIndex, OptimizationWorker* worker )
+{
+	WorkerCounters &counter = counters[workerIndex];
+	WorkRange range;
+	bool stolen;
+	uint64_t items = 0, itemNanoseconds = 0, fetches = 0, fetchingNanoseconds = 0;
+	if (job != 0) {
+		for (;;) {
+			if (stopped())
+				break;
+			auto started = WorkerCounters::Clock::now();
+			bool found = fetch(workerIndex, range, stolen);
+			uint64_t fetching = WorkerCounters::since(started);
+			counter.addFetch(fetching);
+			if (!found) {
+				// Items of other workers are still being processed
+				if (idle != 0 && remaining > 0 && !stopped() && (*idle)(worker))
+					continue;
+				break;
+			}
+			counter.addChunk(stolen);
+			++fetches;
+			fetchingNanoseconds += fetching;
+
+			started = WorkerCounters::Clock::now();
+			(*job)(worker, range.begin, range.end);
+			itemNanoseconds += WorkerCounters::since(started);
+			items += range.size();
+			remaining -= range.size();
+		}
+	}
+
+	auto started = WorkerCounters::Clock::now();
+	std::lock_guard<std::mutex> lock(mutex);
+	counter.addLock(WorkerCounters::since(started));
+	jobItems += items;
+	jobNanoseconds += itemNanoseconds;
+	jobFetches += fetches;
+	fetchNanoseconds += fetchingNanoseconds;
+	if (--busy == 0)
+		jobDone.notify_all();
+}
+
+void PAO::Dispatcher::interrupt()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		interrupted = true;
+	}
+	// run() may be waiting for items no worker will fetch
+	jobDone.notify_all();
+}
+
+void PAO::Dispatcher::setDeadline( std::chrono::steady_clock::time_point deadline )
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	this->deadline = deadline;
+	hasDeadline = true;
+}
+
+bool PAO::Dispatcher::stopped()
+{
+	if (!interruptible)
+		return false;
+	if (hasDeadline && !interrupted && std::chrono::steady_clock::now() >= deadline)
+		interrupted = true;
+	return interrupted;
+}
+
+PAO::WorkerCounters& PAO::Dispatcher::getCounters( unsigned workerIndex )
+{
+	return counters[workerIndex];
+}
+
+void PAO::Dispatcher::wakeAll()
+{
+	// Taking the lock makes sure no thread is between checking its
+	// predicate and going to sleep
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+	}
+	jobReady.notify_all();
+}
+
+bool PAO::Dispatcher::popOwn( unsigned workerIndex, WorkRange &range )
+{
+	std::atomic<uint64_t> &slot = slots[workerIndex].range;
+	uint64_t current = slot.load();
+	for (;;) {
+		unsigned begin = rangeBegin(current);
+		unsigned end = rangeEnd(current);
+		if (begin >= end)
+			return false;
+
+		unsigned size = end-begin;
+		unsigned take;
+		switch (policy) {
+		case StaticSchedule:
+			take = size;
+			break;
+		case DynamicSchedule:
+			take = chunkSize;
+			break;
+		default:
+			take = std::max(chunkSize, (size+1)/2);
+			break;
+		}
+		unsigned newBegin = begin + std::min(size, take);
+		if (slot.compare_exchange_weak(current, pack(newBegin,end))) {
+			range.begin = begin;
+			range.end = newBegin;
+			return true;
+		}
+	}
+}
+
+bool PAO::Dispatcher::steal( unsigned victim, unsigned thief )
+{
+	std::atomic<uint64_t> &slot = slots[victim].range;
+	uint64_t current = slot.load();
+	for (;;) {
+		unsigned begin = rangeBegin(current);
+		unsigned end = rangeEnd(current);
+		if (begin >= end)
+			return false;
+
+		unsigned newEnd = end - (end-begin+1)/2;
+		if (slot.compare_exchange_weak(current, pack(begin,newEnd))) {
+			// Only the owner refills an empty slot, so a plain store is safe
+			slots[thief].range = pack(newEnd, end);
+			return true;
+		}
+	}
+}
+
+bool PAO::Dispatcher::fetch( unsigned workerIndex, WorkRange &range, bool &stolen )
+{
+	stolen = false;
+	for (;;) {
+		if (popOwn(workerIndex, range))
+			return true;
+		if (policy == StaticSchedule)
+			return false;
+
+		bool took = false;
+		for (unsigned i=1; i<workerCount && !took; ++i)
+			took = steal( (workerIndex+i)%workerCount, workerIndex );
+		if (!took)
+			return false;
+		stolen = true;
+	}
+}
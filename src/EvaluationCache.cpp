@@ -0,0 +1,131 @@
+/*
+ * EvaluationCache.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include "Optimizer/Optimizer.h"
+#include "Optimizer/EvaluationCache.h"
+
+
+size_t PAO::EvaluationCache::KeyHash::operator()( const Key &key ) const
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (unsigned i=0; i<key.size(); ++i) {
+		hash ^= (uint64_t)key[i];
+		hash *= 0x100000001b3ULL;
+		hash ^= hash >> 29;
+	}
+	return hash;
+}
+
+PAO::EvaluationCache::EvaluationCache( ParameterBounds &bounds, double relativeTolerance,
+		unsigned maxEntries, unsigned shards )
+{
+	for (int i=0; i<bounds.size(); ++i) {
+		double range = bounds.max[i] - bounds.min[i];
+		origin.push_back( bounds.min[i] );
+		tolerance.push_back( range > 0 ? range*relativeTolerance : 1 );
+	}
+	shardCount = std::max(1u, shards);
+	entriesPerShard = std::max(1u, maxEntries/shardCount);
+	this->shards.reset( new Shard[shardCount] );
+	hits = 0;
+	misses = 0;
+	collapsed = 0;
+}
+
+PAO::EvaluationCache::~EvaluationCache()
+{
+}
+
+void PAO::EvaluationCache::makeKey( const double* x, Key &key )
+{
+	key.resize(tolerance.size());
+	for (unsigned i=0; i<tolerance.size(); ++i)
+		key[i] = (int64_t)std::floor( (x[i]-origin[i])/tolerance[i] );
+}
+
+PAO::CacheLookup_t PAO::EvaluationCache::acquire( const Key &key, double &fitness, bool wait )
+{
+	Shard &shard = shardOf(key);
+	std::unique_lock<std::mutex> lock(shard.mutex);
+
+	auto found = shard.entries.find(key);
+	if (found == shard.entries.end()) {
+		// Reserve the cell, the caller evaluates it
+		Entry entry;
+		entry.key = key;
+		entry.fitness = 0;
+		entry.pending = true;
+		shard.lru.push_front(entry);
+		shard.entries[key] = shard.lru.begin();
+		++misses;
+		return CacheReserved;
+	}
+
+	if (found->second->pending) {
+		if (!wait)
+			return CacheBusy;
+		++collapsed;
+		shard.ready.wait(lock, [&] {
+			found = shard.entries.find(key);
+			return found == shard.entries.end() || !found->second->pending; });
+
+		if (found == shard.entries.end()) {
+			// The evaluation was abandoned, take over the reservation
+			lock.unlock();
+			return acquire(key, fitness, wait);
+		}
+	}
+
+	// Move to front of LRU list
+	shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+	fitness = found->second->fitness;
+	++hits;
+	return CacheHit;
+}
+
+void PAO::EvaluationCache::release( const Key &key, double fitness )
+{
+	Shard &shard = shardOf(key);
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto found = shard.entries.find(key);
+		if (found == shard.entries.end())
+			return;
+		found->second->fitness = fitness;
+		found->second->pending = false;
+		evict(shard);
+	}
+	shard.ready.notify_all();
+}
+
+void PAO::EvaluationCache::abandon( const Key &key )
+{
+	Shard &shard = shardOf(key);
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto found = shard.entries.find(key);
+		if (found == shard.entries.end() || !found->second->pending)
+			return;
+		shard.lru.erase(found->second);
+		shard.entries.erase(found);
+	}
+	shard.ready.notify_all();
+}
+
+void PAO::EvaluationCache::evict( Shard &shard )
+{
+	auto it = shard.lru.end();
+	while (shard.entries.size() > entriesPerShard && it != shard.lru.begin()) {
+		--it;
+		if (it->pending)
+			continue;
+		shard.entries.erase(it->key);
+		it = shard.lru.erase(it);
+	}
+}
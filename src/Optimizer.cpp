@@ -14,9 +14,12 @@
 #include <fstream>
 #include <sys/time.h>
 #include <chrono>
+#include <algorithm>
+#include <cmath>
 
 
 #include "Optimizer/Optimizer.h"
+#include "Optimizer/Random.h"
 //#include "tools/Various/Common.h"
 
 
@@ -34,13 +37,13 @@
 
 
 
-std::mt19937 generator;
-
-double PAO::randomBetween( double min, double max ) 
+namespace
 {
-	return ( ((double)generator())/generator.max() * (max-min) ) + min;
+	/** Longest time a worker waits before looking for stragglers again */
+	const int64_t SpeculationPollNanoseconds = 1000*1000;
 }
 
+
 /*****************************************************************
  *
  * 					Class OptimizationParameters
@@ -87,8 +90,19 @@ void PAO::OptimizationWorker::cancelWorker()
 PAO::OptimizationWorker::OptimizationWorker() 
 {
 	master=0;
+	index=0;
+	counters=0;
+	batchSize=1;
+	batchLayout=RowMajor;
 	stop = false;
 	thrd = 0;
+	evaluationItem = NoEvaluationItem;
+	evaluationSequence = 0;
+	evaluationToken = 0;
+	cancelledToken = 0;
+	evaluationStarted = 0;
+	evaluationTimed = false;
+	evaluationAbandoned = false;
 }
 
 PAO::OptimizationWorker::~OptimizationWorker() 
@@ -96,31 +110,287 @@ PAO::OptimizationWorker::~OptimizationWorker()
 }
 
 /** Thread does work in this function until all work is done.
-	 * Responsible for locking/getting input data, starting simulation, and locking/saving output. */
+	 * Waits for jobs from the master's Dispatcher and processes them until stopped. */
 void PAO::OptimizationWorker::doWork() 
 {
+	Dispatcher &dispatcher = master->getDispatcher();
+	unsigned epoch = 0;
 	for (;;) {
-		master->waitForStartSignal();
+		auto started = WorkerCounters::Clock::now();
+		bool working = dispatcher.waitForJob(epoch, stop);
+		counters->addIdle(WorkerCounters::since(started));
+		if (!working)
+			break;
+		dispatcher.work(index, this);
+	}
+}
 
-		for (;;) {
-			std::list<OptimizationData*> dataList = master->fetchChunkOfIndata();
-			if (dataList.empty()) {
-				stop=true;
-				break;
-			}
-			std::list<OptimizationData*>::iterator it;
-			for (it=dataList.begin(); it!=dataList.end(); ++it) {
-				// Run simulation
-				double result = fitnessFunction((*it)->parameters);
-				// Save fitness value
-				(*it)->fitnessValue = result;
-			}
-			master->pushToOutdata( dataList );
+void PAO::OptimizationWorker::setMaster( MasterOptimizer* master, unsigned index )
+{
+	this->master = master;
+	this->index = index;
+	counters = &master->getDispatcher().getCounters(index);
+	reserveBuffers();
+}
+
+void PAO::OptimizationWorker::reserveBuffers()
+{
+	unsigned dimensions = parameterBounds.size();
+	Parameters fresh;
+	fresh.reserve(dimensions);
+	candidate.swap(fresh);
+	std::vector<double> freshBatch;
+	freshBatch.reserve((size_t)batchSize*dimensions);
+	batch.swap(freshBatch);
+	std::vector<double> freshFitness;
+	freshFitness.reserve(batchSize);
+	batchFitness.swap(freshFitness);
+	EvaluationCache::Key freshKey;
+	freshKey.reserve(dimensions);
+	pointKey.swap(freshKey);
+}
+
+double PAO::OptimizationWorker::fitnessFunction( Parameters &parameters )
+{
+	ERROR("Implement fitnessFunction(Parameters&) or fitnessFunction(Parameters&, EvaluationContext&)");
+	return 0;
+}
+
+double PAO::OptimizationWorker::fitnessFunction( Parameters &parameters, EvaluationContext &context )
+{
+	return fitnessFunction(parameters);
+}
+
+double PAO::OptimizationWorker::evaluate( const double* x, unsigned dimensions, double cutoff, bool* lowerBound )
+{
+	if (lowerBound != 0)
+		*lowerBound = false;
+	EvaluationCache* cache = master ? master->getEvaluationCache() : 0;
+	double fitness;
+	if (cache != 0) {
+		cache->makeKey(x, pointKey);
+		auto started = WorkerCounters::Clock::now();
+		CacheLookup_t lookup = cache->acquire(pointKey, fitness);
+		counters->addLock(WorkerCounters::since(started));
+		if (lookup == CacheHit)
+			return fitness;
+	}
+
+	candidate.assign(x, x+dimensions);
+	EvaluationContext context(cutoff);
+	beginEvaluation(1);
+	fitness = fitnessFunction(candidate, context);
+	bool valid = endEvaluation(&fitness, 1);
+	if (valid && context.isLowerBound) {
+		fitness = std::max(fitness, cutoff);
+		if (lowerBound != 0)
+			*lowerBound = true;
+		if (counters != 0)
+			counters->addCutoffs(1);
+		valid = false;
+	}
+
+	if (cache != 0) {
+		if (valid)
+			cache->release(pointKey, fitness);
+		else
+			cache->abandon(pointKey);
+	}
+	return fitness;
+}
+
+double PAO::OptimizationWorker::evaluate( Parameters &parameters )
+{
+	if (master != 0 && master->getEvaluationCache() != 0)
+		return evaluate(&parameters[0], parameters.size());
+
+	EvaluationContext context;
+	beginEvaluation(1);
+	double fitness = fitnessFunction(parameters, context);
+	endEvaluation(&fitness, 1);
+	return fitness;
+}
+
+void PAO::OptimizationWorker::beginEvaluation( unsigned count )
+{
+	auto now = WorkerCounters::Clock::now();
+	double timeout = getEvaluationTimeout();
+	evaluationTimed = timeout > 0 && !enforcesTimeout();
+	if (evaluationTimed)
+		evaluationDeadline = now + std::chrono::duration_cast<WorkerCounters::Clock::duration>(
+				std::chrono::duration<double>(timeout*count));
+	evaluationAbandoned = false;
+	evaluationToken = ((uint64_t)++evaluationSequence << 32) | evaluationItem;
+	evaluationStarted = now.time_since_epoch().count();
+}
+
+bool PAO::OptimizationWorker::endEvaluation( double* fitness, unsigned count )
+{
+	auto now = WorkerCounters::Clock::now();
+	WorkerCounters::Clock::time_point started( (WorkerCounters::Clock::duration(evaluationStarted)) );
+	evaluationStarted = 0;
+	if (counters != 0)
+		counters->addEvaluations(count, std::chrono::duration_cast<std::chrono::nanoseconds>(now - started).count());
+
+	if (evaluationTimed && now > evaluationDeadline) {
+		std::fill(fitness, fitness+count, getTimeoutPenalty());
+		addTimeouts(count);
+		return false;
+	}
+	if (evaluationAbandoned) {
+		// The fitness-function may have returned before it was done
+		std::fill(fitness, fitness+count, std::numeric_limits<double>::max());
+		return false;
+	}
+	return true;
+}
+
+bool PAO::OptimizationWorker::shouldStop()
+{
+	if (stop)
+		return true;
+	if (evaluationStarted == 0)
+		return false;
+
+	if (cancelledToken == evaluationToken || (master != 0 && master->getDispatcher().isInterrupted())) {
+		evaluationAbandoned = true;
+		return true;
+	}
+	return evaluationTimed && WorkerCounters::Clock::now() > evaluationDeadline;
+}
+
+int64_t PAO::OptimizationWorker::getEvaluationAge()
+{
+	int64_t started = evaluationStarted;
+	if (started == 0)
+		return -1;
+	WorkerCounters::Clock::duration age = WorkerCounters::Clock::now().time_since_epoch() - WorkerCounters::Clock::duration(started);
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(age).count();
+}
+
+double PAO::OptimizationWorker::getEvaluationTimeout()
+{
+	return master != 0 ? master->getEvaluationTimeout() : 0;
+}
+
+double PAO::OptimizationWorker::getTimeoutPenalty()
+{
+	return master != 0 ? master->getTimeoutPenalty() : std::numeric_limits<double>::max();
+}
+
+void PAO::OptimizationWorker::addTimeouts( unsigned count )
+{
+	if (counters != 0)
+		counters->addTimeouts(count);
+}
+
+void PAO::OptimizationWorker::fitnessFunctionBatch( const double* candidates, unsigned count,
+		unsigned dimensions, double* fitness )
+{
+	candidate.resize(dimensions);
+	for (unsigned c=0; c<count; ++c) {
+		for (unsigned j=0; j<dimensions; ++j)
+			candidate[j] = (batchLayout==RowMajor) ? candidates[c*dimensions+j] : candidates[j*count+c];
+		EvaluationContext context;
+		fitness[c] = fitnessFunction(candidate, context);
+	}
+}
+
+void PAO::OptimizationWorker::evaluate( const double* rows, unsigned stride, unsigned count,
+		unsigned dimensions, double* fitness, const double* cutoffs, unsigned char* lowerBounds )
+{
+	if (batchSize <= 1) {
+		for (unsigned i=0; i<count; ++i) {
+			bool lowerBound;
+			fitness[i] = evaluate(rows + (size_t)i*stride, dimensions,
+					cutoffs ? cutoffs[i] : std::numeric_limits<double>::infinity(), &lowerBound);
+			if (lowerBounds != 0)
+				lowerBounds[i] = lowerBound;
 		}
+		return;
+	}
+
+	// Batches are evaluated without cutoffs, so every value is exact
+	if (lowerBounds != 0)
+		std::fill(lowerBounds, lowerBounds+count, 0);
+
+	EvaluationCache* cache = master ? master->getEvaluationCache() : 0;
+	for (unsigned first=0; first<count; first+=batchSize) {
+		unsigned n = std::min(batchSize, count-first);
+		const double* block = rows + (size_t)first*stride;
+		if (cache != 0)
+			evaluateCached(cache, block, stride, n, dimensions, fitness+first);
+		else
+			evaluateBatch(block, stride, 0, n, dimensions, fitness+first);
+	}
+}
 
-		if (shouldStop())
+bool PAO::OptimizationWorker::evaluateBatch( const double* rows, unsigned stride, const unsigned* indices,
+		unsigned n, unsigned dimensions, double* fitness )
+{
+	if (indices==0 && batchLayout==RowMajor && stride==dimensions) {
+		// Already contiguous
+		beginEvaluation(n);
+		fitnessFunctionBatch(rows, n, dimensions, fitness);
+		return endEvaluation(fitness, n);
+	}
+
+	batch.resize((size_t)n*dimensions);
+	for (unsigned c=0; c<n; ++c) {
+		const double* row = rows + (size_t)(indices ? indices[c] : c)*stride;
+		for (unsigned j=0; j<dimensions; ++j) {
+			if (batchLayout==RowMajor)
+				batch[(size_t)c*dimensions + j] = row[j];
+			else
+				batch[(size_t)j*n + c] = row[j];
+		}
+	}
+	beginEvaluation(n);
+	fitnessFunctionBatch(&batch[0], n, dimensions, fitness);
+	return endEvaluation(fitness, n);
+}
+
+void PAO::OptimizationWorker::evaluateCached( EvaluationCache* cache, const double* rows, unsigned stride,
+		unsigned count, unsigned dimensions, double* fitness )
+{
+	keys.resize(count);
+	reserved.clear();
+	busy.clear();
+	for (unsigned c=0; c<count; ++c) {
+		cache->makeKey(rows + (size_t)c*stride, keys[c]);
+		switch (cache->acquire(keys[c], fitness[c], false)) {
+		case CacheHit:
+			break;
+		case CacheReserved:
+			reserved.push_back(c);
 			break;
+		case CacheBusy:
+			busy.push_back(c);
+			break;
+		}
 	}
+
+	if (!reserved.empty()) {
+		batchFitness.resize(reserved.size());
+		bool valid = evaluateBatch(rows, stride, &reserved[0], reserved.size(), dimensions, &batchFitness[0]);
+		for (unsigned r=0; r<reserved.size(); ++r) {
+			fitness[reserved[r]] = batchFitness[r];
+			if (valid)
+				cache->release(keys[reserved[r]], batchFitness[r]);
+			else
+				cache->abandon(keys[reserved[r]]);
+		}
+	}
+
+	// All reservations are released, so waiting for other workers is safe now
+	for (unsigned b=0; b<busy.size(); ++b)
+		fitness[busy[b]] = evaluate(rows + (size_t)busy[b]*stride, dimensions);
+}
+
+void PAO::OptimizationWorker::setBatchSize( unsigned size, BatchLayout_t layout )
+{
+	batchSize = std::max(1u, size);
+	batchLayout = layout;
 }
 
 /** Function used when starting worker in new thread. */
@@ -187,36 +457,32 @@ void PAO::MasterOptimizer::optimizeRandomSearch()
 
 	std::vector<OptimizationData> allTestableSolutions;
 	allTestableSolutions.reserve(N);
-
-	inmutex.lock();
+	std::vector<OptimizationData*> indata;
+	indata.reserve(N);
 
 	for (int n=0; n<params; ++n) {
 		for (int i=0;i<steps; ++i) {
 			OptimizationData s;
 			s.parameters.clear();
+			RandomStream random(seed, n*steps+i);
 
 			for (int param=0; param<params; ++param) {
 				double min = paramBounds->min[param];
 				double max = paramBounds->max[param];
-				double newVal = ((rand()%1000)/1000.0) * (max-min)+min;
+				double newVal = random.uniform(min, max);
 				s.parameters.push_back( newVal );
 			}
 
 			allTestableSolutions.push_back(s);
-			indataList.push_front( &(allTestableSolutions.back()) );
+			indata.push_back( &(allTestableSolutions.back()) );
 			//std::cout << allTestableSolutions[i+n*steps].params[0] << std::endl;
 		}
 	}
-	inmutex.unlock();
-
-	chunkSize = allTestableSolutions.size() / workers.size();
 
-	std::cout << "indataList now contains "<<indataList.size() << " elements. Chunksize is "<<chunkSize<<std::endl;
+	std::cout << "Evaluating "<<indata.size() << " elements"<<std::endl;
 	std::cout.flush();
 
-	notifyWorkers();
-
-	waitUntilProcessed( allTestableSolutions.size() );
+	evaluate( &indata[0], indata.size() );
 
 	std::cout <<std::endl;
 	// All parameters tested, load the best parameters found
@@ -265,7 +531,6 @@ void PAO::MasterOptimizer::optimizeBruteforce()
 			min = paramBounds->min[param];
 			max = paramBounds->max[param];
 			allTestableSolutions[i].parameters[param] = newVal;
-			indataList.push_front( &(allTestableSolutions[i]) );
 			i += 1;
 			if (i>=N)
 				break;
@@ -275,11 +540,15 @@ void PAO::MasterOptimizer::optimizeBruteforce()
 		} while (newVal<max);
 	}
 
-	std::cout << "indataList now contains "<<indataList.size() << " elements"<<std::endl;
+	std::vector<OptimizationData*> indata;
+	for (unsigned n=0; n<allTestableSolutions.size(); ++n)
+		indata.push_back( &(allTestableSolutions[n]) );
+
+	std::cout << "Evaluating "<<indata.size() << " elements"<<std::endl;
 	std::cout.flush();
 
 	// Now, wait for all to be done
-	notifyWorkers();
+	evaluate( &indata[0], indata.size() );
 
 	// All parameters tested, load the best parameters found
 	std::vector<OptimizationData>::iterator it;
@@ -291,50 +560,332 @@ void PAO::MasterOptimizer::optimizeBruteforce()
 	}
 }
 
-/** Fetch OptimizationData from the input queue.
- * 	The number of items fetched depends on number of threads. */
-std::list<PAO::OptimizationData*> PAO::MasterOptimizer::fetchChunkOfIndata() 
+void PAO::MasterOptimizer::evaluate( OptimizationData** data, unsigned count )
 {
-	std::list<OptimizationData*> fetched;
-	std::unique_lock<std::mutex> lock(inmutex);
-	waitForStartSignal(lock);
-	//fetched.reserve(chunkSize);
-	unsigned indataSize = indataList.size();
-	for ( unsigned i=0; i < indataSize && i < chunkSize; ++i ) {
-		OptimizationData* indata = indataList.front();
-		indataList.pop_front();
-		fetched.push_back(indata);
+	unsigned batch = getBatchSize();
+	if (batch <= 1) {
+		for (unsigned i=0; i<count; ++i)
+			data[i]->fitnessValue = std::numeric_limits<double>::max();
+		runJob(count, chunkSize, [data](OptimizationWorker* worker, unsigned begin, unsigned end) {
+			for (unsigned i=begin; i<end; ++i)
+				data[i]->fitnessValue = worker->evaluate(data[i]->parameters);
+		}, schedule, true);
+		return;
+	}
+
+	// Gather into rows so that workers receive whole batches
+	unsigned dimensions = paramBounds->size();
+	gatherRows.resize((size_t)count*dimensions);
+	gatherFitness.resize(count);
+	for (unsigned i=0; i<count; ++i)
+		std::copy(data[i]->parameters.begin(), data[i]->parameters.end(), gatherRows.begin() + (size_t)i*dimensions);
+
+	evaluate(&gatherRows[0], dimensions, count, &gatherFitness[0]);
+
+	for (unsigned i=0; i<count; ++i)
+		data[i]->fitnessValue = gatherFitness[i];
+}
+
+void PAO::MasterOptimizer::evaluate( const double* rows, unsigned stride, unsigned count, double* fitness,
+		const double* cutoffs, unsigned char* lowerBounds )
+{
+	// Work is handed out in blocks of one batch each, so that no batch is split
+	rowJob.rows = rows;
+	rowJob.stride = stride;
+	rowJob.count = count;
+	rowJob.dimensions = paramBounds->size();
+	rowJob.batch = getBatchSize();
+	rowJob.fitness = fitness;
+	rowJob.cutoffs = cutoffs;
+	rowJob.lowerBounds = lowerBounds;
+	rowJob.speculative = speculationFactor > 0 && rowJob.batch == 1 && !cache && workers.size() > 1;
+	unsigned blocks = (count + rowJob.batch-1)/rowJob.batch;
+	unsigned blocksPerChunk = std::max(1u, chunkSize/rowJob.batch);
+	std::fill(fitness, fitness+count, std::numeric_limits<double>::max());
+	if (lowerBounds != 0)
+		std::fill(lowerBounds, lowerBounds+count, 0);
+
+	if (rowJob.speculative) {
+		if (count > rowStateCount) {
+			rowStates.reset( new std::atomic<unsigned char>[count] );
+			rowStateCount = count;
+		}
+		for (unsigned i=0; i<count; ++i)
+			rowStates[i] = RowPending;
+	}
+
+	runJob(blocks, blocksPerChunk, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+		evaluateRows(worker, begin, end); }, schedule, true, rowJob.speculative ? &speculateJob : 0);
+}
+
+void PAO::MasterOptimizer::evaluateRows( OptimizationWorker* worker, unsigned begin, unsigned end )
+{
+	unsigned first = begin*rowJob.batch;
+	unsigned last = std::min(rowJob.count, end*rowJob.batch);
+	if (!rowJob.speculative) {
+		worker->evaluate(rowJob.rows + (size_t)first*rowJob.stride, rowJob.stride, last-first,
+				rowJob.dimensions, rowJob.fitness+first, rowJob.cutoffs ? rowJob.cutoffs+first : 0,
+				rowJob.lowerBounds ? rowJob.lowerBounds+first : 0);
+		return;
+	}
+
+	// One row at a time so that idle workers can see which row each worker is on
+	for (unsigned i=first; i<last; ++i) {
+		worker->setEvaluationItem(i);
+		bool lowerBound;
+		double fitness = worker->evaluate(rowJob.rows + (size_t)i*rowJob.stride, rowJob.dimensions, cutoffOf(i), &lowerBound);
+		worker->setEvaluationItem(NoEvaluationItem);
+		finishRow(worker, i, fitness, lowerBound);
+	}
+}
+
+bool PAO::MasterOptimizer::speculate( OptimizationWorker* worker )
+{
+	uint64_t evaluations = 0, nanoseconds = 0;
+	for (unsigned w=0; w<workers.size(); ++w) {
+		evaluations += dispatcher.getCounters(w).getEvaluations();
+		nanoseconds += dispatcher.getCounters(w).getEvaluationNanoseconds();
+	}
+	if (evaluations == 0)
+		return false;
+	int64_t threshold = speculationFactor*nanoseconds/evaluations;
+
+	// Duplicate the row that has been evaluated the longest, if long enough
+	unsigned straggler = NoEvaluationItem;
+	int64_t oldest = -1;
+	int64_t wait = std::numeric_limits<int64_t>::max();
+	for (unsigned w=0; w<workers.size(); ++w) {
+		unsigned item = (uint32_t)workers[w]->getEvaluationToken();
+		int64_t age = workers[w]->getEvaluationAge();
+		if (workers[w] == worker || item >= rowJob.count || age < 0 || rowStates[item] != RowPending)
+			continue;
+		if (age >= threshold && age > oldest) {
+			straggler = item;
+			oldest = age;
+		}
+		else if (age < threshold)
+			wait = std::min(wait, threshold-age);
+	}
+
+	if (straggler == NoEvaluationItem) {
+		if (wait == std::numeric_limits<int64_t>::max())
+			return false;
+		// Look again when the oldest row becomes a straggler, unless the job ends first
+		std::this_thread::sleep_for(std::chrono::nanoseconds(std::min<int64_t>(wait, SpeculationPollNanoseconds)));
+		return true;
+	}
+
+	unsigned char pending = RowPending;
+	if (!rowStates[straggler].compare_exchange_strong(pending, RowDuplicated))
+		return true;
+	dispatcher.getCounters(worker->getIndex()).addSpeculation();
+	worker->setEvaluationItem(straggler);
+	bool lowerBound;
+	double fitness = worker->evaluate(rowJob.rows + (size_t)straggler*rowJob.stride, rowJob.dimensions, cutoffOf(straggler), &lowerBound);
+	worker->setEvaluationItem(NoEvaluationItem);
+	finishRow(worker, straggler, fitness, lowerBound);
+	return true;
+}
+
+void PAO::MasterOptimizer::finishRow( OptimizationWorker* worker, unsigned i, double fitness, bool lowerBound )
+{
+	unsigned char previous = rowStates[i].exchange(RowDone);
+	if (previous == RowDone)
+		return;
+	rowJob.fitness[i] = fitness;
+	if (rowJob.lowerBounds != 0)
+		rowJob.lowerBounds[i] = lowerBound;
+
+	if (previous == RowDuplicated) {
+		for (unsigned w=0; w<workers.size(); ++w) {
+			uint64_t token = workers[w]->getEvaluationToken();
+			if (workers[w] != worker && (uint32_t)token == i)
+				workers[w]->cancelEvaluation(token);
+		}
+	}
+}
+
+void PAO::MasterOptimizer::resetUtilization()
+{
+	utilizationBase = getTotalStatistics().evaluationSeconds;
+	parallelSeconds = 0;
+	utilizationStart = std::chrono::steady_clock::now();
+}
+
+double PAO::MasterOptimizer::getUtilization()
+{
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - utilizationStart;
+	if (elapsed.count() <= 0)
+		return 0;
+	double busy = getTotalStatistics().evaluationSeconds - utilizationBase;
+	return busy / (elapsed.count()*workers.size());
+}
+
+void PAO::MasterOptimizer::getWorkerStatistics( std::vector<WorkerStatistics> &statistics )
+{
+	statistics.resize(workers.size());
+	for (unsigned i=0; i<workers.size(); ++i)
+		dispatcher.getCounters(i).snapshot(statistics[i]);
+}
+
+PAO::WorkerStatistics PAO::MasterOptimizer::getTotalStatistics()
+{
+	WorkerStatistics total;
+	for (unsigned i=0; i<workers.size(); ++i) {
+		WorkerStatistics statistics;
+		dispatcher.getCounters(i).snapshot(statistics);
+		total += statistics;
 	}
-	return fetched;
+	return total;
+}
+
+unsigned PAO::MasterOptimizer::getBatchSize()
+{
+	unsigned batch = 1;
+	for (unsigned i=0; i<workers.size(); ++i)
+		batch = std::max(batch, workers[i]->getBatchSize());
+	return batch;
 }
 
-void PAO::MasterOptimizer::pushToOutdata( std::list<OptimizationData*> &data ) 
+void PAO::MasterOptimizer::parallelFor( unsigned count, unsigned chunkSize, const JobFunction& fun,
+		SchedulePolicy_t policy )
 {
-	outmutex.lock();
-	std::list<OptimizationData*>::iterator it = outdataList.end();
-	outdataList.insert(it, data.begin(), data.end());
-	outmutex.unlock();
+	runJob(count, chunkSize, fun, policy);
+}
 
-	// Notify MasterOptimizer that some solutions are ready
-	outdataReady.notify_all();
+void PAO::MasterOptimizer::runJob( unsigned count, unsigned chunkSize, const JobFunction& fun,
+		SchedulePolicy_t policy, bool interruptible, const IdleFunction* idle )
+{
+	auto started = std::chrono::steady_clock::now();
+	dispatcher.run(count, chunkSize, fun, policy, interruptible, idle);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+	parallelSeconds += elapsed.count();
 }
 
-/** Block until all data scheduled for computation have been computed. */
-void PAO::MasterOptimizer::waitUntilProcessed( unsigned itemsToProcess ) 
+uint64_t PAO::MasterOptimizer::countEvaluations()
 {
-	std::unique_lock<std::mutex> lock(outmutex);
-	outdataReady.wait(lock, [&] {
-		return (itemsToProcess == outdataList.size()) ; });
+	uint64_t evaluations = 0;
+	for (unsigned i=0; i<workers.size(); ++i)
+		evaluations += dispatcher.getCounters(i).getEvaluations();
+	return evaluations;
+}
+
+void PAO::MasterOptimizer::resetStopping()
+{
+	stopReason = StopCompleted;
+	stopRequested = false;
+	evaluationsBase = countEvaluations();
+	stallFitness = std::numeric_limits<double>::max();
+	stallGeneration = 0;
+
+	dispatcher.clearInterrupt();
+	if (stoppingCriteria.maxSeconds > 0) {
+		deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>(stoppingCriteria.maxSeconds));
+		dispatcher.setDeadline(deadline);
+	}
+	else
+		dispatcher.clearDeadline();
+}
+
+bool PAO::MasterOptimizer::checkStop( double bestFitness )
+{
+	if (isStopping())
+		return true;
+
+	if (stopRequested)
+		stopReason = StopRequested;
+	else if (bestFitness <= stoppingCriteria.targetFitness)
+		stopReason = StopTargetReached;
+	else if (stoppingCriteria.maxEvaluations > 0 &&
+			countEvaluations() - evaluationsBase >= stoppingCriteria.maxEvaluations)
+		stopReason = StopEvaluationLimit;
+	else if (stoppingCriteria.maxSeconds > 0 && std::chrono::steady_clock::now() >= deadline)
+		stopReason = StopDeadline;
+
+	// Evaluations not yet handed out are skipped
+	if (isStopping())
+		dispatcher.interrupt();
+	return isStopping();
+}
+
+bool PAO::MasterOptimizer::checkGeneration( unsigned generation, double bestFitness, double diversity )
+{
+	if (bestFitness < stallFitness - stoppingCriteria.stallTolerance) {
+		stallFitness = bestFitness;
+		stallGeneration = generation;
+	}
+	if (checkStop(bestFitness))
+		return true;
+
+	if (stoppingCriteria.stallGenerations > 0 && generation - stallGeneration >= stoppingCriteria.stallGenerations)
+		stopReason = StopStalled;
+	else if (diversity >= 0 && diversity < stoppingCriteria.minDiversity)
+		stopReason = StopConverged;
+	else if (callbackStop != 0 && callbackStop(generation, bestFitness))
+		stopReason = StopCallback;
+
+	if (isStopping())
+		dispatcher.interrupt();
+	return isStopping();
+}
+
+double PAO::MasterOptimizer::diversity( const double* rows, unsigned stride, unsigned count )
+{
+	unsigned dimensions = paramBounds->size();
+	if (count < 2)
+		return 0;
+
+	// Mean of each parameter, then the squared deviations from it
+	diversitySums.assign(2*dimensions, 0);
+	double* mean = &diversitySums[0];
+	double* squares = mean + dimensions;
+	for (unsigned i=0; i<count; ++i)
+		for (unsigned j=0; j<dimensions; ++j)
+			mean[j] += rows[(size_t)i*stride + j];
+	for (unsigned j=0; j<dimensions; ++j)
+		mean[j] /= count;
+	for (unsigned i=0; i<count; ++i)
+		for (unsigned j=0; j<dimensions; ++j) {
+			double deviation = rows[(size_t)i*stride + j] - mean[j];
+			squares[j] += deviation*deviation;
+		}
+
+	double sum = 0;
+	for (unsigned j=0; j<dimensions; ++j) {
+		double range = paramBounds->max[j] - paramBounds->min[j];
+		if (range > 0)
+			sum += squares[j]/(range*range*count);
+	}
+	return std::sqrt(sum/dimensions);
+}
+
+void PAO::MasterOptimizer::requestStop()
+{
+	stopRequested = true;
+	dispatcher.interrupt();
 }
 
 PAO::MasterOptimizer::MasterOptimizer( std::vector<OptimizationWorker*> workers ) 
 {
-	unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-	generator.seed(seed);
+	setSeed( std::chrono::system_clock::now().time_since_epoch().count() );
 	this->workers = workers;
-	workersDone = false;
 	callbackFoundNewMinimum = 0;	
+	callbackGeneration = 0;
+	callbackStop = 0;
+	stopReason = StopCompleted;
+	stopRequested = false;
+	evaluationsBase = 0;
+	stallFitness = std::numeric_limits<double>::max();
+	stallGeneration = 0;
+	rowStateCount = 0;
+	speculateJob = [this](OptimizationWorker* worker) {return speculate(worker);};
+	evaluationTimeout = 0;
+	timeoutPenalty = std::numeric_limits<double>::max();
+	speculationFactor = 0;
 	chunkSize = 1;
+	schedule = AdaptiveSchedule;
+	workerCpus.assign(workers.size(), -1);
 	paramBounds = &(workers.front()->getParameterBounds());
 	if (paramBounds->size()<=0)
 		ERROR("Please set appropriate parameter-bounds.\nParameterBounds->size<=0");
@@ -342,9 +893,11 @@ PAO::MasterOptimizer::MasterOptimizer( std::vector<OptimizationWorker*> workers
 	std::cout << "\nMasterOptimizer: Using "<< workers.size() << " threads.\n";
 
 	// Initialize the worker pool
+	dispatcher.setWorkerCount(workers.size());
+	resetUtilization();
 	for (unsigned i=0; i<workers.size(); ++i)
 	{		
-		workers[i]->setMaster(this);
+		workers[i]->setMaster(this, i);
 		workers[i]->startWorker();
 	}
 }
@@ -355,23 +908,42 @@ PAO::MasterOptimizer::~MasterOptimizer()
 		workers[i]->cancelWorker();
 }
 
-/** Unlock indata queue so that worker threads may start computations */
+/** Wake worker threads so that they may check if they should stop */
 void PAO::MasterOptimizer::notifyWorkers( )
 {
-	indataReady.notify_all();
+	dispatcher.wakeAll();
 };
 
-/** Block until optimizing algorithm sends start signal */
-void PAO::MasterOptimizer::waitForStartSignal(std::unique_lock<std::mutex> &lock)
+void PAO::MasterOptimizer::enableEvaluationCache( double relativeTolerance, unsigned maxEntries )
+{
+	cache.reset( new EvaluationCache(*paramBounds, relativeTolerance, maxEntries) );
+}
+
+void PAO::MasterOptimizer::setEvaluationTimeout( double seconds, double penalty )
+{
+	evaluationTimeout = seconds;
+	timeoutPenalty = penalty;
+}
+
+void PAO::MasterOptimizer::setAffinity( AffinityPolicy_t policy, std::vector<unsigned> cpus )
 {
-	indataReady.wait(lock, [&] {
-		return (indataList.size()>0 || workersDone) ; });
+	if (policy == ExplicitAffinity && cpus.empty())
+		ERROR("ExplicitAffinity needs a list of cpus");
+	workerCpus = CpuTopology().assign(policy, workers.size(), cpus);
+
+	// With a static schedule and one item per worker, every worker runs
+	// the job exactly once for its own index
+	parallelFor(workers.size(), 1, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+		if (!pinCurrentThread(workerCpus[worker->getIndex()]))
+			WARN("Could not pin worker "<<worker->getIndex()<<" to cpu "<<workerCpus[worker->getIndex()]);
+		worker->reserveBuffers();
+	}, StaticSchedule);
 }
 
-void PAO::MasterOptimizer::waitForStartSignal()
+void PAO::MasterOptimizer::setSeed( uint64_t seed )
 {
-	std::unique_lock<std::mutex> lock(inmutex);
-	waitForStartSignal(lock);
+	this->seed = seed;
+	setRandomSeed(seed);
 }
 
 void PAO::MasterOptimizer::setCallbackNewMinimum( void(*fun)(double, double) )
@@ -379,6 +951,39 @@ void PAO::MasterOptimizer::setCallbackNewMinimum( void(*fun)(double, double) )
 	callbackFoundNewMinimum=fun;
 };
 
+void PAO::MasterOptimizer::setCallbackGeneration( void(*fun)(unsigned, double) )
+{
+	callbackGeneration=fun;
+}
+
+void PAO::MasterOptimizer::setCallbackStop( bool(*fun)(unsigned, double) )
+{
+	callbackStop=fun;
+}
+
+const char* PAO::getStopReasonName( StopReason_t reason )
+{
+	switch (reason) {
+	case StopCompleted:
+		return "all generations done";
+	case StopTargetReached:
+		return "target fitness reached";
+	case StopStalled:
+		return "no improvement";
+	case StopConverged:
+		return "population converged";
+	case StopEvaluationLimit:
+		return "evaluation limit reached";
+	case StopDeadline:
+		return "time limit reached";
+	case StopCallback:
+		return "stopped by callback";
+	case StopRequested:
+		return "stop requested";
+	}
+	return "unknown";
+}
+
 /*****************************************************************
  *
  * 					Various
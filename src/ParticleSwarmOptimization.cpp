@@ -15,10 +15,33 @@
 #include <fstream>
 #include <ctime>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 
 #include "Optimizer/ParticleSwarmOptimization.h"
+#include "Optimizer/SwarmStore.h"
 
 
+#ifndef ERROR
+	/** Macro generates coloured output with file and line number */
+	#define WARN(TO_COUT)  {std::string strfile(__FILE__);\
+		strfile = strfile.substr(strfile.rfind('/')+1, std::string::npos);\
+		std::cout<<"\e[0;33mWarning: "<<strfile<<":"<<__LINE__<<" - "<<	TO_COUT << "\e[0m" << std::endl<<std::flush;}
+
+	#define ERROR(TO_COUT)  {std::string strfile(__FILE__);\
+		strfile = strfile.substr(strfile.rfind('/')+1, std::string::npos);\
+		std::cout<<"\e[0;31mERROR: "<<strfile<<":"<<__LINE__<<" - "<<	TO_COUT << "\e[0m" << std::endl<<std::flush;\
+		abort();}
+#endif
+
+namespace
+{
+	const char CheckpointMagic[8] = {'P','A','O','P','S','O',0,0};
+	/** Increase when the layout of checkpoints changes */
+	const uint32_t CheckpointVersion = 1;
+}
+
 
 
 double PAO::ParticleSwarmOptimizer::optimize()
@@ -33,142 +56,775 @@ double PAO::ParticleSwarmOptimizer::optimize()
 		std::cout << "Using neighborhood best variant\n";
 		break;
 	}
+	switch (pso.update) {
+	case SynchronousUpdate:
+		std::cout << "Using synchronous update\n";
+		break;
+	case AsynchronousUpdate:
+		std::cout << "Using asynchronous update\n";
+		break;
+	}
+	if (pso.swarmMode == IslandSwarms) {
+		std::cout << "Running swarms as islands with "<<pso.migrants<<" migrants every "<<pso.migrationInterval<<" generations in ";
+		std::cout << (pso.migrationTopology==RingMigration ? "ring" : "fully connected") << " topology\n";
+	}
 	std::cout << "Using PSO:c1="<<pso.c1<<", PSO:c2="<<pso.c2<<std::endl;
 
 	bestParameters.fitnessValue = std::numeric_limits<double>::max();
 
-	for (unsigned swarm=0;swarm<pso.swarms; ++swarm) {
-		std::cout << "Initiating swarm "<<swarm+1<< " of "<<pso.swarms<<std::endl;
-		unsigned params = paramBounds->size();
-		std::vector<SwarmParticle> allParticles;
-		allParticles.reserve(pso.particleCount);
-		double inertia=0.95;
-
-		// Set up random starting positions
-		for (unsigned i=0; i<pso.particleCount; ++i)
-		{
-			SwarmParticle particle;
-			for (unsigned param=0; param<params; ++param) {
-				// Set up initial position
-				double min = paramBounds->min[param];
-				double max = paramBounds->max[param];
-				double newVal = randomBetween(min, max);
-				particle.x.parameters.push_back( newVal );
-
-				// Set up initial velocity
-				newVal = randomBetween(0,1)/100 * (max-min)+min; // Todo: look over v_begin
-				particle.v.push_back( newVal );
-			}
-			particle.x.fitnessValue =  std::numeric_limits<double>::max();
-			particle.p = particle.x;
-			allParticles.push_back(particle);
+	std::cout << "Using "<<getVelocityKernelName()<<" velocity kernel"<<std::endl;
+
+	// Islands are all held in one store and run as a single swarm would
+	islands = (pso.swarmMode == IslandSwarms) ? pso.swarms : 1;
+	unsigned runs = pso.swarms / islands;
+
+	std::unique_ptr<MappedFile> checkpoint;
+	const CheckpointHeader* header = 0;
+	unsigned firstSwarm = 0;
+	if (!resumeFile.empty()) {
+		checkpoint.reset( new MappedFile(resumeFile) );
+		header = checkCheckpoint(*checkpoint);
+		setSeed(header->seed);
+		firstSwarm = header->swarm;
+		std::cout << "Resuming swarm "<<firstSwarm+1<<" at generation "<<header->generation<<" from "<<resumeFile<<std::endl;
+	}
+	if (pso.checkpointInterval > 0 && pso.update == AsynchronousUpdate)
+		WARN("Checkpoints are only written with synchronous update");
+
+	// The surrogate learns from every swarm of the run
+	surrogate.reset();
+	surrogateSavings = 0;
+	if (pso.surrogateFraction > 0 && pso.surrogateFraction < 1) {
+		if (pso.update == AsynchronousUpdate) {
+			WARN("The surrogate is only used with synchronous update");
+		}
+		else {
+			surrogate.reset( new SurrogateModel(*paramBounds, pso.surrogateNeighbors, pso.surrogateCapacity) );
+			std::cout << "Evaluating "<<pso.surrogateFraction*100<<"% of particles chosen by a surrogate of "
+					<<surrogate->getNeighbors()<<" nearest neighbours"<<std::endl;
+		}
+	}
+
+	std::cout << "Using seed "<<seed<<std::endl;
+
+	partialBests.resize(workers.size()*islands);
+	resetUtilization();
+	resetStopping();
+
+	for (swarm=firstSwarm; swarm<runs && !isStopping(); ++swarm) {
+		if (header != 0) {
+			allocateSwarm();
+			restoreCheckpoint(header);
+			header = 0;
+			checkpoint.reset();
+		}
+		else {
+			if (islands == 1)
+				std::cout << "Initiating swarm "<<swarm+1<< " of "<<pso.swarms<<std::endl;
+			else
+				std::cout << "Initiating "<<islands<<" islands"<<std::endl;
+			initializeSwarm();
+		}
+
+		switch (pso.update) {
+		case SynchronousUpdate:
+			runSynchronous();
+			break;
+		case AsynchronousUpdate:
+			parallelFor(workers.size(), 1, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+				runAsynchronous(worker); });
+			break;
+		}
+
+		// A swarm ended by a stopping criterion is not refined
+		if (pso.refineCount > 0 && !isStopping())
+			refine();
+	}
+
+	checkpointWriter.wait();
+	if (isStopping())
+		std::cout << "Stopped early: "<<getStopReasonName(stopReason)<<std::endl;
+	std::cout << "Worker utilization: "<<getUtilization()*100<<"%"<<std::endl;
+	WorkerStatistics total = getTotalStatistics();
+	std::cout << "Worker time: "<<total.evaluationSeconds<<" s evaluating, "<<total.fetchSeconds<<" s fetching work, ";
+	std::cout << total.lockSeconds<<" s waiting for locks, "<<total.idleSeconds<<" s idle, in "<<total.chunks<<" chunks"<<std::endl;
+	if (total.timeouts > 0 || total.speculations > 0 || total.cutoffs > 0)
+		std::cout << "Evaluations: "<<total.timeouts<<" timed out, "<<total.speculations<<" duplicated by idle workers, "
+				<<total.cutoffs<<" stopped at their cutoff"<<std::endl;
+	if (surrogate)
+		std::cout << "Surrogate: "<<surrogateSavings<<" evaluations saved"<<std::endl;
+	if (cache)
+		std::cout << "Evaluation cache: "<<cache->getHits()<<" hits ("<<cache->getCollapsed()<<" waited for an evaluation in progress), "<<cache->getMisses()<<" misses"<<std::endl;
+
+	return bestParameters.fitnessValue;
+}
+
+double PAO::ParticleSwarmOptimizer::resume( std::string filename )
+{
+	if (pso.update != SynchronousUpdate)
+		ERROR("Only runs with synchronous update can be resumed");
+
+	resumeFile = filename;
+	double best = optimize();
+	resumeFile.clear();
+	return best;
+}
+
+void PAO::ParticleSwarmOptimizer::initializeSwarm()
+{
+	allocateSwarm();
+
+	// Every worker first touches the share of particles it starts each job with,
+	// which places it on the worker's node
+	parallelFor(store.size(), 1, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+		initializeParticles(worker, begin, end); }, StaticSchedule);
+
+	for (unsigned k=0; k<islands; ++k)
+		memcpy(islandBest(k), store.position((k+1)*pso.particleCount-1), store.stride()*sizeof(double));
+	generation = 0;
+}
+
+void PAO::ParticleSwarmOptimizer::allocateSwarm()
+{
+	unsigned threads = workers.size();
+	inertia=0.95;
+
+	store.resize(pso.particleCount*islands, *paramBounds);
+	unsigned stride = store.stride();
+	neighborhoodBest.resize(store.size());
+	particleBusy.assign(store.size(), 0);
+	randomNumbers.resize(3*stride*threads);
+	// moveParticle only draws dimensions() numbers per row, the padding lanes
+	// must stay zero so the kernels keep the padding of the swarm at zero.
+	randomNumbers.fill(0);
+	swarmBest.resize(stride*islands);
+	swarmBestFitness.assign(islands, std::numeric_limits<double>::max());
+
+	unsigned migrants = std::min(pso.migrants, pso.particleCount/2);
+	migrantRows.resize(std::max(1u, migrants*islands*stride));
+	migrantFitness.resize(migrants*islands);
+	migrantIndex.resize(migrants*islands);
+
+	if (pso.update == AsynchronousUpdate) {
+		// All particles start out in the queue of particles waiting to be moved
+		readyParticles.resize(store.size());
+		for (unsigned i=0; i<store.size(); ++i)
+			readyParticles[i] = i;
+		readyHead = 0;
+		readyCount = store.size();
+		particleEvaluations.assign(store.size(), 0);
+		evaluationsIssued = 0;
+		evaluationsCompleted = 0;
+		evaluationBudget = pso.generations * store.size();
+		nextMigration = pso.migrationInterval * store.size();
+	}
+
+	if (surrogate) {
+		predictions.resize(store.size());
+		screenOrder.resize(store.size());
+		screenRows.resize((size_t)stride*store.size());
+		screenFitness.resize(store.size());
+		screenCutoffs.resize(store.size());
+		screenLowerBounds.resize(store.size());
+	}
+}
+
+void PAO::ParticleSwarmOptimizer::runSynchronous()
+{
+	unsigned threads = workers.size();
+	unsigned stride = store.stride();
+	unsigned runs = pso.swarms / islands;
+
+	// Work is split in a few partitions per worker so that stealing can even out the load
+	unsigned partition = std::max(1u, store.size()/(4*threads));
+
+	refineStallFitness = std::numeric_limits<double>::max();
+	refineStallGeneration = generation;
+
+	// Start main swarm loop, generation is not 0 when resuming
+	for (; generation<pso.generations;++generation) {
+
+		parallelFor(store.size(), partition, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+			updateParticles(worker, begin, end); });
+
+		// Lower inertia for next generation
+		//inertia -= 0.7/pso.generations;
+
+		// Evaluate all particles on the workers. Only fitness-values better
+		// than the personal best change anything, so they are the cutoffs.
+		if (!surrogate)
+			evaluate( store.positionData(), stride, store.size(), store.fitnessData(), &store.bestFitness(0) );
+		else if (surrogate->size() < surrogate->getNeighbors()) {
+			evaluate( store.positionData(), stride, store.size(), store.fitnessData(), &store.bestFitness(0),
+					screenLowerBounds.data() );
+			surrogate->add( store.positionData(), stride, store.size(), store.fitnessData(), screenLowerBounds.data() );
+		}
+		else
+			evaluateScreened( partition );
+
+		for (unsigned i=0; i<partialBests.size(); ++i) {
+			partialBests[i].fitness = std::numeric_limits<double>::max();
+			partialBests[i].index = store.size();
+		}
 
-			if (pso.variant == NeighborhoodBest) {
-				allParticles.back().l = &(allParticles.back().x);
-				//std::cout <<  "Setting particle.l to "<< &(particle.x)<<""<< std::endl;
+		parallelFor(store.size(), partition, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+			updateBests(worker, begin, end); });
+
+		double progress = (swarm*pso.generations + generation)/((double)pso.generations * runs);
+		for (unsigned k=0; k<islands; ++k) {
+			// Merge the best of each worker into population best location.
+			// Ties go to the lowest index so the result does not depend on the partitioning.
+			PartialBest* best = &partialBests[k];
+			for (unsigned i=1; i<threads; ++i) {
+				PartialBest* partial = &partialBests[i*islands + k];
+				if ( partial->fitness < best->fitness ||
+						(partial->fitness == best->fitness && partial->index < best->index) )
+					best = partial;
 			}
+			if ( best->fitness < swarmBestFitness[k] ) {
+				memcpy(islandBest(k), store.position(best->index), stride*sizeof(double));
+				swarmBestFitness[k] = best->fitness;
+			}
+
+			updateBestParameters( k, progress );
 		}
 
-		chunkSize =  allParticles.size() / workers.size();
-		if (chunkSize > 20*workers.size()) // Todo: cleanup
-			chunkSize /= 10;
-		else if (chunkSize==0)
-			chunkSize+=1;
-
-		OptimizationData swarmBestParameters;
-		swarmBestParameters.fitnessValue = std::numeric_limits<double>::max();
-		swarmBestParameters.parameters = allParticles.back().x.parameters;
-
-		timespec clockStarted;
-		clock_gettime(CLOCK_REALTIME,&clockStarted);
-
-		// Start main swarm loop
-		for (unsigned generation=0; generation<pso.generations;++generation) {
-			if (pso.variant == NeighborhoodBest) {
-				for (unsigned i=0; i < allParticles.size(); ++i) {
-					// Update neighborhood best location
-
-					// Use ring topology
-					unsigned prev = (i-1+allParticles.size())%allParticles.size();
-					unsigned next = (i+1+allParticles.size())%allParticles.size();
-					if ( allParticles[next].p.fitnessValue < allParticles[i].p.fitnessValue ) {
-						allParticles[i].l = &(allParticles[next].p);
-						//std::cout << "Particle "<<i<<" found new neighborhood max "<<allParticles[i].l->fitnessValue <<std::endl;
-						//std::cout.flush();
-					}
-					if ( allParticles[prev].p.fitnessValue < allParticles[i].p.fitnessValue ) {
-						allParticles[i].l = &(allParticles[prev].p);
-						//std::cout << "Particle "<<i<<" found new neighborhood max "<<allParticles[i].l->fitnessValue <<std::endl;
-						//std::cout.flush();
-					}
-				}
+		if (islands > 1 && pso.migrationInterval > 0 && (generation+1)%pso.migrationInterval == 0)
+			migrate();
+
+		if (pso.checkpointInterval > 0 && (generation+1)%pso.checkpointInterval == 0)
+			saveCheckpoint();
+
+		if (callbackGeneration != 0)
+			callbackGeneration(swarm*pso.generations + generation+1, bestParameters.fitnessValue);
+
+		if (checkGeneration(swarm*pso.generations + generation+1, bestParameters.fitnessValue,
+				wantsDiversity() ? islandDiversity() : -1))
+			break;
+
+		if (pso.refineCount > 0 && pso.refineStall > 0) {
+			double best = *std::min_element(swarmBestFitness.begin(), swarmBestFitness.end());
+			if (best < refineStallFitness - pso.refineStallTolerance) {
+				refineStallFitness = best;
+				refineStallGeneration = generation;
 			}
+			else if (generation - refineStallGeneration >= pso.refineStall) {
+				std::cout << "Swarm stalled after "<<generation+1<<" generations, refining"<<std::endl;
+				break;
+			}
+		}
+	}
+}
+
+void PAO::ParticleSwarmOptimizer::refine()
+{
+	unsigned dims = store.dimensions();
+	unsigned stride = store.stride();
+	const std::vector<double> &lower = paramBounds->min;
+	const std::vector<double> &upper = paramBounds->max;
+
+	// Pick the best personal bests that differ by at least a step in some parameter
+	refineStarts.resize(store.size());
+	for (unsigned i=0; i<store.size(); ++i)
+		refineStarts[i] = i;
+	std::sort(refineStarts.begin(), refineStarts.end(), [this](unsigned a, unsigned b) {
+		return store.bestFitness(a) < store.bestFitness(b) || (store.bestFitness(a) == store.bestFitness(b) && a < b); });
+
+	refinePoints.resize(pso.refineCount*stride);
+	refineFitness.resize(pso.refineCount);
+	refineSteps.resize(pso.refineCount);
+	unsigned searches = 0;
+	for (unsigned i=0; i<store.size() && searches<pso.refineCount; ++i) {
+		const double* x = store.best(refineStarts[i]);
+		if (store.bestFitness(refineStarts[i]) == std::numeric_limits<double>::max())
+			break;
+
+		bool distinct = true;
+		for (unsigned s=0; s<searches && distinct; ++s) {
+			const double* y = refinePoints.data() + (size_t)s*stride;
+			distinct = false;
+			for (unsigned j=0; j<dims && !distinct; ++j)
+				distinct = std::fabs(x[j]-y[j]) >= pso.refineStep*(upper[j]-lower[j]);
+		}
+		if (!distinct)
+			continue;
 
-			double c1=pso.c1,c2=pso.c2;
-
-			// Update particle locations
-			for (unsigned i=0; i<pso.particleCount; ++i) {
-				for (unsigned j=0; j<params; ++j) {
-					switch (pso.variant) {
-					case NeighborhoodBest:
-						allParticles[i].v[j] = allParticles[i].v[j]*inertia
-							+ c1*randomBetween(0,1)*(allParticles[i].p.parameters[j]-allParticles[i].x.parameters[j])
-							+ c2*randomBetween(0,1)*(allParticles[i].l->parameters[j]-allParticles[i].x.parameters[j]);
-						break;
-					case PopulationBest:
-						allParticles[i].v[j] = allParticles[i].v[j]*inertia
-							+ c1*randomBetween(0,1)*(allParticles[i].p.parameters[j]-allParticles[i].x.parameters[j])
-							+ c2*randomBetween(0,1)*(swarmBestParameters.parameters[j]-allParticles[i].x.parameters[j]);
-						break;
-					}
-
-					double newPos = allParticles[i].x.parameters[j] + allParticles[i].v[j];
-					if (newPos < paramBounds->min[j])
-						newPos = paramBounds->min[j];
-					if (newPos > paramBounds->max[j])
-						newPos = paramBounds->max[j];
-					allParticles[i].x.parameters[j] = newPos;
+		memcpy(refinePoints.data() + (size_t)searches*stride, x, stride*sizeof(double));
+		refineFitness[searches] = store.bestFitness(refineStarts[i]);
+		refineSteps[searches] = pso.refineStep;
+		++searches;
+	}
+	if (searches == 0)
+		return;
+
+	std::cout << "Refining "<<searches<<" solutions with pattern search"<<std::endl;
+	stencilRows.resize(searches*2*dims*stride);
+	stencilFitness.resize(searches*2*dims);
+	stencilCutoffs.resize(searches*2*dims);
+	uint64_t evaluationsBefore = countEvaluations();
+	double progress = (swarm+1)/(double)(pso.swarms/islands);
+
+	// Compass search: every search tries a step in both directions of every
+	// parameter, moves to the best point and doubles its step if it is better
+	// and halves its step if not.
+	// The stencils of all searches are evaluated together on the workers.
+	for (unsigned iteration=0; iteration<pso.refineIterations; ++iteration) {
+		unsigned count = 0;
+		for (unsigned s=0; s<searches; ++s) {
+			if (refineSteps[s] == 0)
+				continue;
+			const double* x = refinePoints.data() + (size_t)s*stride;
+			for (unsigned j=0; j<2*dims; ++j, ++count) {
+				double* row = stencilRows.data() + (size_t)count*stride;
+				memcpy(row, x, stride*sizeof(double));
+				unsigned param = j/2;
+				double step = refineSteps[s]*(upper[param]-lower[param]);
+				row[param] = std::min(upper[param], std::max(lower[param], (j%2 ? x[param]-step : x[param]+step)));
+				// Only points better than the search's own are of use
+				stencilCutoffs[count] = refineFitness[s];
+			}
+		}
+		if (count == 0)
+			break;
+
+		evaluate( stencilRows.data(), stride, count, stencilFitness.data(), stencilCutoffs.data() );
+
+		count = 0;
+		for (unsigned s=0; s<searches; ++s) {
+			if (refineSteps[s] == 0)
+				continue;
+			unsigned best = count;
+			for (unsigned j=count+1; j<count+2*dims; ++j)
+				if (stencilFitness[j] < stencilFitness[best])
+					best = j;
+
+			if (stencilFitness[best] < refineFitness[s]) {
+				memcpy(refinePoints.data() + (size_t)s*stride, stencilRows.data() + (size_t)best*stride, stride*sizeof(double));
+				refineFitness[s] = stencilFitness[best];
+				refineSteps[s] = std::min(1.0, 2*refineSteps[s]);
+				if (refineFitness[s] < bestParameters.fitnessValue) {
+					bestParameters.parameters.assign(refinePoints.data() + (size_t)s*stride, refinePoints.data() + (size_t)s*stride + dims);
+					bestParameters.fitnessValue = refineFitness[s];
+					if (callbackFoundNewMinimum!=0)
+						callbackFoundNewMinimum(bestParameters.fitnessValue, progress);
 				}
 			}
+			else {
+				refineSteps[s] *= 0.5;
+				if (refineSteps[s] < pso.refineMinStep)
+					refineSteps[s] = 0;
+			}
+			count += 2*dims;
+		}
 
-			// Lower inertia for next generation
-			//inertia -= 0.7/pso.generations;
+		if (checkStop(bestParameters.fitnessValue))
+			break;
+	}
 
-			// Add particles to queue
-			inmutex.lock();
-			for (unsigned i=0; i<pso.particleCount; ++i)
-				indataList.push_back( &(allParticles[i].x) );
-			inmutex.unlock();
+	std::cout << "Refinement took "<<countEvaluations()-evaluationsBefore<<" evaluations, best "<<bestParameters.fitnessValue<<std::endl;
+}
 
-			notifyWorkers();
+void PAO::ParticleSwarmOptimizer::evaluateScreened( unsigned partition )
+{
+	unsigned stride = store.stride();
+	unsigned n = pso.particleCount;
+	unsigned chosen = std::min(n, std::max(1u, (unsigned)std::ceil(pso.surrogateFraction*n)));
+
+	// Predictions only read the surrogate, so they run on all workers.
+	// The scratch rows of updateParticles are free meanwhile.
+	parallelFor(store.size(), partition, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+		double* scratch = randomNumbers.data() + 3*store.stride()*worker->getIndex();
+		for (unsigned i=begin; i<end; ++i)
+			predictions[i] = surrogate->predict(store.position(i), scratch); });
+
+	// Pick the best predictions of each island, ties going to the lowest index
+	unsigned count = 0;
+	for (unsigned k=0; k<islands; ++k) {
+		unsigned* first = &screenOrder[(size_t)k*n];
+		for (unsigned i=0; i<n; ++i)
+			first[i] = k*n + i;
+		std::nth_element(first, first+chosen-1, first+n, [this](unsigned a, unsigned b) {
+			return predictions[a] < predictions[b] || (predictions[a] == predictions[b] && a < b); });
+		std::sort(first, first+chosen);
+
+		for (unsigned j=0; j<chosen; ++j, ++count) {
+			memcpy(screenRows.data() + (size_t)count*stride, store.position(first[j]), stride*sizeof(double));
+			screenCutoffs[count] = store.bestFitness(first[j]);
+		}
+	}
 
-			waitUntilProcessed( allParticles.size() );
+	evaluate( screenRows.data(), stride, count, screenFitness.data(), screenCutoffs.data(), screenLowerBounds.data() );
+	surrogate->add( screenRows.data(), stride, count, screenFitness.data(), screenLowerBounds.data() );
 
-			outdataList.clear();
+	// A prediction is never trusted to improve a personal best, so only
+	// evaluated particles can change the bests
+	for (unsigned i=0; i<store.size(); ++i)
+		store.fitness(i) = std::max(predictions[i], store.bestFitness(i));
+	count = 0;
+	for (unsigned k=0; k<islands; ++k)
+		for (unsigned j=0; j<chosen; ++j)
+			store.fitness(screenOrder[(size_t)k*n + j]) = screenFitness[count++];
 
-			// Check solutions
-			for (unsigned part=0; part < allParticles.size(); ++part) {
-				// Update particle's best location
-				if (allParticles[part].x.fitnessValue < allParticles[part].p.fitnessValue ) {
-					allParticles[part].p = allParticles[part].x;
-				}
+	surrogateSavings += store.size() - count;
+}
 
-				// Update population best location
-				if ( allParticles[part].x.fitnessValue < swarmBestParameters.fitnessValue ) {
-					swarmBestParameters = allParticles[part].x;
+void PAO::ParticleSwarmOptimizer::saveCheckpoint()
+{
+	size_t particles = store.size();
+	size_t stride = store.stride();
+	size_t dims = store.dimensions();
+	size_t rows = particles*stride*sizeof(double);
+
+	std::vector<char> &buffer = checkpointWriter.buffer();
+	buffer.resize(sizeof(CheckpointHeader) + 3*rows + 2*particles*sizeof(double)
+			+ islands*(stride+1)*sizeof(double) + dims*sizeof(double));
+
+	CheckpointHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CheckpointMagic, sizeof(header.magic));
+	header.version = CheckpointVersion;
+	header.dimensions = dims;
+	header.fileSize = buffer.size();
+	header.seed = seed;
+	header.swarms = pso.swarms;
+	header.particleCount = pso.particleCount;
+	header.islands = islands;
+	header.generations = pso.generations;
+	header.swarm = swarm;
+	header.generation = generation+1;
+	header.stride = stride;
+	header.inertia = inertia;
+	header.bestFitness = bestParameters.fitnessValue;
+
+	char* p = buffer.data();
+	memcpy(p, &header, sizeof(header));						p += sizeof(header);
+	memcpy(p, store.position(0), rows);						p += rows;
+	memcpy(p, store.best(0), rows);							p += rows;
+	memcpy(p, store.velocity(0), rows);						p += rows;
+	memcpy(p, &store.fitness(0), particles*sizeof(double));		p += particles*sizeof(double);
+	memcpy(p, &store.bestFitness(0), particles*sizeof(double));	p += particles*sizeof(double);
+	memcpy(p, swarmBest.data(), islands*stride*sizeof(double));	p += islands*stride*sizeof(double);
+	memcpy(p, swarmBestFitness.data(), islands*sizeof(double));	p += islands*sizeof(double);
+	if (bestParameters.parameters.size() == dims)
+		memcpy(p, bestParameters.parameters.data(), dims*sizeof(double));
+	else
+		memset(p, 0, dims*sizeof(double));
+
+	checkpointWriter.commit(pso.checkpointFile);
+}
 
-					if (swarmBestParameters.fitnessValue < bestParameters.fitnessValue) {
-						bestParameters = swarmBestParameters;
-						if (callbackFoundNewMinimum!=0)
-							callbackFoundNewMinimum(bestParameters.fitnessValue, (swarm*pso.generations + generation)/((double)pso.generations * pso.swarms));
-					}
-				}
+const PAO::ParticleSwarmOptimizer::CheckpointHeader* PAO::ParticleSwarmOptimizer::checkCheckpoint( MappedFile &file )
+{
+	if (!file.isOpen())
+		ERROR("Could not open checkpoint "<<resumeFile);
+
+	const CheckpointHeader* header = (const CheckpointHeader*)file.begin();
+	if (file.size() < sizeof(CheckpointHeader) || memcmp(header->magic, CheckpointMagic, sizeof(header->magic)) != 0)
+		ERROR(resumeFile<<" is not a PSO checkpoint");
+	if (header->version != CheckpointVersion)
+		ERROR("Checkpoint "<<resumeFile<<" has version "<<header->version<<", expected "<<CheckpointVersion);
+	if (header->fileSize != file.size())
+		ERROR("Checkpoint "<<resumeFile<<" is truncated");
+	if ((int)header->dimensions != paramBounds->size() || header->swarms != pso.swarms ||
+			header->particleCount != pso.particleCount || header->islands != islands ||
+			header->generations != pso.generations)
+		ERROR("Checkpoint "<<resumeFile<<" was written with other parameters");
+	return header;
+}
+
+void PAO::ParticleSwarmOptimizer::restoreCheckpoint( const CheckpointHeader* header )
+{
+	size_t particles = store.size();
+	size_t stride = store.stride();
+	size_t dims = store.dimensions();
+	size_t rows = particles*stride*sizeof(double);
+	if (header->stride != stride)
+		ERROR("Checkpoint "<<resumeFile<<" was written with another row stride");
+
+	const char* p = (const char*)(header+1);
+	memcpy(store.position(0), p, rows);						p += rows;
+	memcpy(store.best(0), p, rows);							p += rows;
+	memcpy(store.velocity(0), p, rows);						p += rows;
+	memcpy(&store.fitness(0), p, particles*sizeof(double));		p += particles*sizeof(double);
+	memcpy(&store.bestFitness(0), p, particles*sizeof(double));	p += particles*sizeof(double);
+	memcpy(swarmBest.data(), p, islands*stride*sizeof(double));	p += islands*stride*sizeof(double);
+	memcpy(swarmBestFitness.data(), p, islands*sizeof(double));	p += islands*sizeof(double);
+
+	bestParameters.fitnessValue = header->bestFitness;
+	bestParameters.parameters.assign((const double*)p, (const double*)p + dims);
+	inertia = header->inertia;
+	generation = header->generation;
+}
+
+void PAO::ParticleSwarmOptimizer::runAsynchronous( OptimizationWorker* worker )
+{
+	unsigned stride = store.stride();
+	unsigned params = store.dimensions();
+	double* random = randomNumbers.data() + 3*stride*worker->getIndex();
+	double* guide = random + 2*stride;
+	unsigned runs = pso.swarms / islands;
+
+	std::unique_lock<std::mutex> lock(asyncMutex);
+
+	// readyCount is zero when there are more workers than particles
+	while (evaluationsIssued < evaluationBudget && readyCount > 0 && !isStopping()) {
+		unsigned i = readyParticles[readyHead];
+		readyHead = (readyHead+1) % store.size();
+		--readyCount;
+		++evaluationsIssued;
+		unsigned substream = ++particleEvaluations[i];
+		unsigned k = islandOf(i);
+		double cutoff = store.bestFitness(i);
+		particleBusy[i] = 1;
+
+		// Copy the currently known best, other workers may change it once unlocked
+		if (pso.variant == NeighborhoodBest)
+			memcpy(guide, store.best(findNeighborhoodBest(i)), stride*sizeof(double));
+		else
+			memcpy(guide, islandBest(k), stride*sizeof(double));
+		lock.unlock();
+
+		// Only this worker touches the position and velocity of particle i until it is back in the queue
+		moveParticle(i, guide, random, substream);
+
+		double fitness = worker->evaluate(store.position(i), params, cutoff);
+
+		auto started = WorkerCounters::Clock::now();
+		lock.lock();
+		dispatcher.getCounters(worker->getIndex()).addLock(WorkerCounters::since(started));
+		store.fitness(i) = fitness;
+		if (fitness < store.bestFitness(i)) {
+			memcpy(store.best(i), store.position(i), stride*sizeof(double));
+			store.bestFitness(i) = fitness;
+		}
+		if (fitness < swarmBestFitness[k]) {
+			memcpy(islandBest(k), store.position(i), stride*sizeof(double));
+			swarmBestFitness[k] = fitness;
+			updateBestParameters( k, (swarm + evaluationsIssued/(double)evaluationBudget) / runs );
+		}
+		particleBusy[i] = 0;
+		readyParticles[(readyHead+readyCount) % store.size()] = i;
+		++readyCount;
+
+		// A generation's worth of evaluations counts as a generation
+		++evaluationsCompleted;
+		if (evaluationsCompleted % store.size() == 0) {
+			unsigned generations = swarm*pso.generations + evaluationsCompleted/store.size();
+			if (callbackGeneration != 0)
+				callbackGeneration(generations, bestParameters.fitnessValue);
+			// Personal bests are only written under the lock, unlike positions
+			checkGeneration(generations, bestParameters.fitnessValue, wantsDiversity() ? islandDiversity() : -1);
+		}
+		else
+			checkStop(bestParameters.fitnessValue);
+
+		if (islands > 1 && pso.migrationInterval > 0 && evaluationsIssued >= nextMigration) {
+			// Migrate as often as the synchronous update would, counted in evaluations.
+			// Only waiting particles are replaced so this is safe under the lock.
+			nextMigration += pso.migrationInterval * store.size();
+			for (unsigned island=0; island<islands; ++island)
+				selectEmigrants(island);
+			for (unsigned island=0; island<islands; ++island)
+				receiveImmigrants(island);
+		}
+	}
+}
+
+double PAO::ParticleSwarmOptimizer::islandDiversity()
+{
+	double spread = 0;
+	for (unsigned k=0; k<islands; ++k)
+		spread = std::max(spread, diversity(store.best(k*pso.particleCount), store.stride(), pso.particleCount));
+	return spread;
+}
+
+void PAO::ParticleSwarmOptimizer::updateBestParameters( unsigned k, double progress )
+{
+	if (swarmBestFitness[k] < bestParameters.fitnessValue) {
+		bestParameters.parameters.assign(islandBest(k), islandBest(k)+store.dimensions());
+		bestParameters.fitnessValue = swarmBestFitness[k];
+		if (callbackFoundNewMinimum!=0)
+			callbackFoundNewMinimum(bestParameters.fitnessValue, progress);
+	}
+}
+
+void PAO::ParticleSwarmOptimizer::migrate()
+{
+	// Emigrants of all islands are selected before any island receives,
+	// so every island sends the particles it had before this migration
+	parallelFor(islands, 1, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+		for (unsigned k=begin; k<end; ++k)
+			selectEmigrants(k);
+	});
+	parallelFor(islands, 1, [this](OptimizationWorker* worker, unsigned begin, unsigned end) {
+		for (unsigned k=begin; k<end; ++k)
+			receiveImmigrants(k);
+	});
+}
+
+void PAO::ParticleSwarmOptimizer::selectEmigrants( unsigned k )
+{
+	unsigned migrants = migrantFitness.size()/islands;
+	unsigned first = k*pso.particleCount;
+	unsigned stride = store.stride();
+	unsigned* chosen = &migrantIndex[k*migrants];
+
+	// Few migrants are sent, so repeated selection beats sorting the island
+	for (unsigned m=0; m<migrants; ++m) {
+		unsigned best = store.size();
+		for (unsigned i=first; i<first+pso.particleCount; ++i) {
+			if (std::find(chosen, chosen+m, i) != chosen+m)
+				continue;
+			if (best == store.size() || store.bestFitness(i) < store.bestFitness(best))
+				best = i;
+		}
+		chosen[m] = best;
+		memcpy(migrantRows.data() + (size_t)(k*migrants+m)*stride, store.best(best), stride*sizeof(double));
+		migrantFitness[k*migrants+m] = store.bestFitness(best);
+	}
+}
+
+void PAO::ParticleSwarmOptimizer::receiveImmigrants( unsigned k )
+{
+	unsigned migrants = migrantFitness.size()/islands;
+	unsigned first = k*pso.particleCount;
+	unsigned stride = store.stride();
+
+	for (unsigned m=0; m<migrants; ++m) {
+		// Pick the migrant to receive
+		unsigned source = (k+islands-1)%islands;
+		unsigned migrant = source*migrants + m;
+		if (pso.migrationTopology == FullyConnectedMigration) {
+			// m:th best among the migrants of all other islands
+			double lower = -std::numeric_limits<double>::max();
+			if (m > 0)
+				lower = migrantFitness[migrantIndex[k*migrants+m-1]];
+			migrant = migrantFitness.size();
+			for (unsigned j=0; j<migrantFitness.size(); ++j) {
+				if (j/migrants == k || migrantFitness[j] < lower)
+					continue;
+				if (m > 0 && migrantFitness[j] == lower && j <= migrantIndex[k*migrants+m-1])
+					continue;
+				if (migrant == migrantFitness.size() || migrantFitness[j] < migrantFitness[migrant])
+					migrant = j;
 			}
+			if (migrant == migrantFitness.size())
+				break;
+			// The emigrant indices of island k are not needed anymore, reuse them
+			migrantIndex[k*migrants+m] = migrant;
+		}
+
+		// Replace the worst particle not being evaluated
+		unsigned worst = store.size();
+		for (unsigned i=first; i<first+pso.particleCount; ++i) {
+			if (particleBusy[i])
+				continue;
+			if (worst == store.size() || store.bestFitness(i) > store.bestFitness(worst))
+				worst = i;
+		}
+		if (worst == store.size() || store.bestFitness(worst) <= migrantFitness[migrant])
+			break;
+
+		const double* row = migrantRows.data() + (size_t)migrant*stride;
+		memcpy(store.position(worst), row, stride*sizeof(double));
+		memcpy(store.best(worst), row, stride*sizeof(double));
+		store.fitness(worst) = migrantFitness[migrant];
+		store.bestFitness(worst) = migrantFitness[migrant];
+
+		if (migrantFitness[migrant] < swarmBestFitness[k]) {
+			memcpy(islandBest(k), row, stride*sizeof(double));
+			swarmBestFitness[k] = migrantFitness[migrant];
 		}
 	}
+}
 
-	workersDone = true;
-	return bestParameters.fitnessValue;
+void PAO::ParticleSwarmOptimizer::initializeParticles( OptimizationWorker* worker, unsigned begin, unsigned end )
+{
+	unsigned params = store.dimensions();
+
+	for (unsigned i=begin; i<end; ++i) {
+		// Substream 0 of each particle is used for initialization
+		RandomStream random(seed, ((uint64_t)swarm<<32) | i, 0);
+		for (unsigned param=0; param<params; ++param) {
+			// Set up initial position
+			double min = paramBounds->min[param];
+			double max = paramBounds->max[param];
+			store.position(i)[param] = random.uniform(min, max);
+
+			// Set up initial velocity
+			store.velocity(i)[param] = random.uniform()/100 * (max-min)+min; // Todo: look over v_begin
+		}
+		store.clearPadding(i);
+		store.fitness(i) = std::numeric_limits<double>::max();
+		memcpy(store.best(i), store.position(i), store.stride()*sizeof(double));
+		store.bestFitness(i) = store.fitness(i);
+		neighborhoodBest[i] = i;
+	}
+}
+
+unsigned PAO::ParticleSwarmOptimizer::findNeighborhoodBest( unsigned i )
+{
+	unsigned n = pso.particleCount;
+	unsigned first = islandOf(i)*n;
+	unsigned local = i-first;
+	unsigned prev = first + (local-1+n)%n;
+	unsigned next = first + (local+1)%n;
+	unsigned best = i;
+	if ( store.bestFitness(next) < store.bestFitness(best) )
+		best = next;
+	if ( store.bestFitness(prev) < store.bestFitness(best) )
+		best = prev;
+	neighborhoodBest[i] = best;
+	return best;
+}
+
+void PAO::ParticleSwarmOptimizer::moveParticle( unsigned i, const double* l, double* random, unsigned substream )
+{
+	double* r1 = random;
+	double* r2 = random + store.stride();
+
+	// Every particle has its own random stream, with one substream per move
+	RandomStream stream(seed, ((uint64_t)swarm<<32) | i, substream);
+	stream.fill(r1, store.dimensions());
+	stream.fill(r2, store.dimensions());
+
+	VelocityKernel updateParticle = getVelocityKernel();
+	updateParticle( store.position(i), store.velocity(i), store.best(i), l,
+			r1, r2, store.lower(), store.upper(),
+			store.stride(), inertia, pso.c1, pso.c2 );
+}
+
+void PAO::ParticleSwarmOptimizer::updateParticles( OptimizationWorker* worker, unsigned begin, unsigned end )
+{
+	double* random = randomNumbers.data() + 3*store.stride()*worker->getIndex();
+
+	for (unsigned i=begin; i<end; ++i) {
+		// Personal bests are not changed during this pass
+		const double* l = islandBest(islandOf(i));
+		if (pso.variant == NeighborhoodBest)
+			l = store.best(findNeighborhoodBest(i));
+
+		moveParticle(i, l, random, generation+1);
+	}
+}
+
+void PAO::ParticleSwarmOptimizer::updateBests( OptimizationWorker* worker, unsigned begin, unsigned end )
+{
+	PartialBest* partials = &partialBests[worker->getIndex()*islands];
+
+	for (unsigned part=begin; part<end; ++part) {
+		// Update particle's best location
+		if (store.fitness(part) < store.bestFitness(part) ) {
+			memcpy(store.best(part), store.position(part), store.stride()*sizeof(double));
+			store.bestFitness(part) = store.fitness(part);
+		}
+
+		PartialBest &partial = partials[islandOf(part)];
+		if ( store.fitness(part) < partial.fitness || (store.fitness(part) == partial.fitness && part < partial.index) ) {
+			partial.fitness = store.fitness(part);
+			partial.index = part;
+		}
+	}
 }
 
 PAO::ParticleSwarmOptimizer::ParticleSwarmOptimizer( 
@@ -178,6 +834,7 @@ PAO::ParticleSwarmOptimizer::ParticleSwarmOptimizer(
  : MasterOptimizer( workers )
 {
 	pso = parameters;
+	surrogateSavings = 0;
 }
 
 PAO::ParticleSwarmOptimizer::~ParticleSwarmOptimizer()
@@ -0,0 +1,290 @@
+/*
+ * ProcessWorker.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <iostream>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <cstdlib>
+#include <limits>
+#include <ctime>
+#include <new>
+#include <algorithm>
+#include <atomic>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <semaphore.h>
+
+#include "Optimizer/ProcessWorker.h"
+
+
+#ifndef ERROR
+	/** Macro generates coloured output with file and line number */
+	#define WARN(TO_COUT)  {std::string strfile(__FILE__);\
+		strfile = strfile.substr(strfile.rfind('/')+1, std::string::npos);\
+		std::cout<<"\e[0;33mWarning: "<<strfile<<":"<<__LINE__<<" - "<<	TO_COUT << "\e[0m" << std::endl<<std::flush;}
+
+	#define ERROR(TO_COUT)  {std::string strfile(__FILE__);\
+		strfile = strfile.substr(strfile.rfind('/')+1, std::string::npos);\
+		std::cout<<"\e[0;31mERROR: "<<strfile<<":"<<__LINE__<<" - "<<	TO_COUT << "\e[0m" << std::endl<<std::flush;\
+		abort();}
+#endif
+
+
+namespace PAO
+{
+	/** Start of the mapping shared with the child process.
+	 *  Candidate n is in slot n%capacity. The parent posts requests once
+	 *  per written candidate and the child posts results once per
+	 *  evaluated candidate, in the same order. */
+	class ProcessRing
+	{
+	public:
+		sem_t requests;
+		sem_t results;
+		std::atomic<int> shutdown;
+	};
+}
+
+namespace
+{
+	/** How often a waiting parent checks that the child is alive */
+	const long PollNanoseconds = 10*1000*1000;
+	/** How often an idle child checks that the parent is alive */
+	const long ChildPollNanoseconds = 1000*1000*1000;
+	/** How long shutdown waits for the child to exit before killing it */
+	const long ShutdownGraceNanoseconds = 1000*1000*1000;
+
+	/** Wait on semaphore for at most nanoseconds. Returns false on timeout. */
+	bool timedWait( sem_t* semaphore, long nanoseconds )
+	{
+		timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += nanoseconds;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000;
+		deadline.tv_nsec %= 1000000000;
+		while (sem_timedwait(semaphore, &deadline) != 0) {
+			if (errno == ETIMEDOUT)
+				return false;
+			if (errno != EINTR)
+				ERROR("sem_timedwait: "<<strerror(errno));
+		}
+		return true;
+	}
+}
+
+PAO::ProcessWorker::ProcessWorker( OptimizationWorker* evaluator, unsigned batchSize, unsigned capacity )
+{
+	this->evaluator = evaluator;
+	this->capacity = std::max(1u, capacity);
+	setParameterBounds(evaluator->getParameterBounds());
+	setBatchSize(batchSize);
+
+	maxAttempts = 3;
+	crashPenalty = std::numeric_limits<double>::max();
+
+	dims = 0;
+	ring = 0;
+	slots = 0;
+	results = 0;
+	mappedSize = 0;
+	child = 0;
+	parent = 0;
+	issued = 0;
+	completed = 0;
+	childStart = 0;
+	crashPosition = std::numeric_limits<uint64_t>::max();
+	crashCount = 0;
+	restarts = 0;
+}
+
+PAO::ProcessWorker::~ProcessWorker()
+{
+	shutdown();
+}
+
+double PAO::ProcessWorker::fitnessFunction( Parameters &parameters )
+{
+	double fitness;
+	fitnessFunctionBatch(&parameters[0], 1, parameters.size(), &fitness);
+	return fitness;
+}
+
+void PAO::ProcessWorker::fitnessFunctionBatch( const double* candidates, unsigned count,
+		unsigned dimensions, double* fitness )
+{
+	if (ring == 0)
+		start(dimensions);
+	else if (dimensions != dims)
+		ERROR("ProcessWorker started for "<<dims<<" dimensions, got "<<dimensions);
+
+	// Keep the ring filled while collecting results in order
+	unsigned sent = 0;
+	lastResult = WorkerCounters::Clock::now();
+	for (unsigned done=0; done<count; ++done) {
+		for (; sent<count && issued-completed<capacity; ++sent, ++issued) {
+			memcpy(slots + (issued%capacity)*dims, candidates + (size_t)sent*dims, dims*sizeof(double));
+			sem_post(&ring->requests);
+		}
+		waitForResult();
+		fitness[done] = results[completed%capacity];
+		++completed;
+	}
+}
+
+void PAO::ProcessWorker::start( unsigned dimensions )
+{
+	dims = dimensions;
+	size_t header = (sizeof(ProcessRing) + CacheLineSize-1)/CacheLineSize*CacheLineSize;
+	mappedSize = header + sizeof(double)*(size_t)capacity*(dims+1);
+
+	void* memory = mmap(0, mappedSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+		ERROR("mmap: "<<strerror(errno));
+
+	ring = new (memory) ProcessRing;
+	ring->shutdown = 0;
+	if (sem_init(&ring->requests, 1, 0) != 0 || sem_init(&ring->results, 1, 0) != 0)
+		ERROR("sem_init: "<<strerror(errno));
+	slots = (double*)((char*)memory + header);
+	results = slots + (size_t)capacity*dims;
+
+	parent = getpid();
+	issued = 0;
+	completed = 0;
+	childStart = 0;
+	forkChild();
+}
+
+void PAO::ProcessWorker::forkChild()
+{
+	pid_t pid = fork();
+	if (pid < 0)
+		ERROR("fork: "<<strerror(errno));
+	if (pid == 0)
+		runChild();
+	child = pid;
+}
+
+void PAO::ProcessWorker::runChild()
+{
+	uint64_t next = childStart;
+
+	for (;;) {
+		if (!timedWait(&ring->requests, ChildPollNanoseconds)) {
+			if (getppid() != parent)
+				_exit(0);
+			continue;
+		}
+		if (ring->shutdown)
+			_exit(0);
+
+		// One candidate at a time, so that the parent knows which candidate
+		// a crash or a timeout belongs to
+		unsigned slot = next%capacity;
+		evaluator->evaluate(slots + (size_t)slot*dims, dims, 1, dims, results + slot);
+		++next;
+		sem_post(&ring->results);
+	}
+}
+
+void PAO::ProcessWorker::waitForResult()
+{
+	double timeout = getEvaluationTimeout();
+	long poll = PollNanoseconds;
+	if (timeout > 0)
+		poll = std::max(1L, std::min(poll, (long)(timeout*1e9)));
+
+	while (!timedWait(&ring->results, poll)) {
+		int status;
+		if (waitpid(child, &status, WNOHANG) != child) {
+			std::chrono::duration<double> waited = WorkerCounters::Clock::now() - lastResult;
+			if (timeout > 0 && waited.count() > timeout) {
+				WARN("Evaluator process "<<child<<" took more than "<<timeout<<" s on a candidate, restarting")
+				kill(child, SIGKILL);
+				waitpid(child, &status, 0);
+				restart(true);
+			}
+			continue;
+		}
+
+		if (WIFSIGNALED(status))
+			WARN("Evaluator process "<<child<<" killed by signal "<<WTERMSIG(status)<<", restarting")
+		else
+			WARN("Evaluator process "<<child<<" exited with status "<<WEXITSTATUS(status)<<", restarting")
+		restart(false);
+	}
+	lastResult = WorkerCounters::Clock::now();
+}
+
+void PAO::ProcessWorker::restart( bool timedOut )
+{
+	++restarts;
+
+	// Results posted before the child died are valid
+	uint64_t finished = completed;
+	while (sem_trywait(&ring->results) == 0)
+		++finished;
+
+	childStart = finished;
+	if (timedOut) {
+		// Unless the result came in before the kill, the candidate waited for hung the child
+		if (finished == completed) {
+			results[finished%capacity] = getTimeoutPenalty();
+			addTimeouts(1);
+			++childStart;
+		}
+	}
+	else if (finished == crashPosition)
+		++crashCount;
+	else {
+		crashPosition = finished;
+		crashCount = 1;
+	}
+
+	if (!timedOut && crashCount >= maxAttempts) {
+		WARN("Giving up a candidate after "<<crashCount<<" crashes");
+		results[finished%capacity] = crashPenalty;
+		++childStart;
+		crashCount = 0;
+	}
+
+	// Requeue everything written but not evaluated
+	sem_destroy(&ring->requests);
+	sem_destroy(&ring->results);
+	sem_init(&ring->requests, 1, issued-childStart);
+	sem_init(&ring->results, 1, childStart-completed);
+	forkChild();
+}
+
+void PAO::ProcessWorker::shutdown()
+{
+	if (ring == 0)
+		return;
+
+	ring->shutdown = 1;
+	sem_post(&ring->requests);
+
+	// A child stuck in the fitness-function never sees the flag
+	bool exited = false;
+	for (long waited=0; waited<ShutdownGraceNanoseconds && !exited; waited+=PollNanoseconds) {
+		exited = waitpid(child, 0, WNOHANG) != 0;
+		if (!exited)
+			usleep(PollNanoseconds/1000);
+	}
+	if (!exited) {
+		WARN("Evaluator process "<<child<<" did not exit, killing it")
+		kill(child, SIGKILL);
+		waitpid(child, 0, 0);
+	}
+
+	sem_destroy(&ring->requests);
+	sem_destroy(&ring->results);
+	ring->~ProcessRing();
+	munmap(ring, mappedSize);
+	ring = 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * Random.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <atomic>
+#include <cmath>
+
+#include "Optimizer/Optimizer.h"
+#include "Optimizer/Random.h"
+
+
+namespace
+{
+	const uint32_t PhiloxM0 = 0xD2511F53;
+	const uint32_t PhiloxM1 = 0xCD9E8D57;
+	const uint32_t PhiloxW0 = 0x9E3779B9;
+	const uint32_t PhiloxW1 = 0xBB67AE85;
+	const unsigned PhiloxRounds = 10;
+
+	/** Number of counters processed in lockstep by RandomStream::fill */
+	const unsigned Lanes = 8;
+
+	/** Combine two 32-bit words to a double in [0,1) with 53 random bits */
+	inline double toUnit( uint32_t a, uint32_t b )
+	{
+		uint64_t bits = (((uint64_t)a << 32) | b) >> 11;
+		return bits * (1.0/9007199254740992.0);
+	}
+
+	std::atomic<uint64_t> globalSeed(0);
+	std::atomic<uint64_t> threadStreams(0);
+}
+
+void PAO::RandomStream::block( uint64_t seed, uint32_t counter[4], uint32_t result[4] )
+{
+	uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed>>32);
+	uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+
+	for (unsigned round=0; round<PhiloxRounds; ++round) {
+		uint64_t p0 = (uint64_t)PhiloxM0 * c0;
+		uint64_t p1 = (uint64_t)PhiloxM1 * c2;
+		uint32_t n0 = (uint32_t)(p1>>32) ^ c1 ^ k0;
+		uint32_t n2 = (uint32_t)(p0>>32) ^ c3 ^ k1;
+		c1 = (uint32_t)p1;
+		c3 = (uint32_t)p0;
+		c0 = n0;
+		c2 = n2;
+		k0 += PhiloxW0;
+		k1 += PhiloxW1;
+	}
+	result[0] = c0; result[1] = c1; result[2] = c2; result[3] = c3;
+}
+
+PAO::RandomStream::RandomStream( uint64_t seed, uint64_t stream, uint32_t substream )
+{
+	this->seed = seed;
+	counter[0] = 0;
+	counter[1] = substream;
+	counter[2] = (uint32_t)stream;
+	counter[3] = (uint32_t)(stream>>32);
+	buffered = 0;
+}
+
+double PAO::RandomStream::uniform()
+{
+	if (buffered < 2) {
+		block(seed, counter, buffer);
+		++counter[0];
+		buffered = 4;
+	}
+	buffered -= 2;
+	return toUnit(buffer[buffered+1], buffer[buffered]);
+}
+
+double PAO::RandomStream::normal()
+{
+	// Box-Muller transform, 1-u keeps the logarithm finite
+	double r = std::sqrt(-2*std::log(1-uniform()));
+	return r*std::cos(6.283185307179586*uniform());
+}
+
+void PAO::RandomStream::fill( double* out, unsigned n, double min, double max )
+{
+	const uint32_t key0 = (uint32_t)seed, key1 = (uint32_t)(seed>>32);
+	const double scale = max-min;
+	unsigned i=0;
+
+	// Each block gives two numbers, so Lanes blocks give 2*Lanes numbers
+	for (; i+2*Lanes<=n; i+=2*Lanes) {
+		uint32_t c0[Lanes], c1[Lanes], c2[Lanes], c3[Lanes];
+		for (unsigned l=0; l<Lanes; ++l) {
+			c0[l] = counter[0]+l;
+			c1[l] = counter[1];
+			c2[l] = counter[2];
+			c3[l] = counter[3];
+		}
+		uint32_t k0 = key0, k1 = key1;
+		for (unsigned round=0; round<PhiloxRounds; ++round) {
+			for (unsigned l=0; l<Lanes; ++l) {
+				uint64_t p0 = (uint64_t)PhiloxM0 * c0[l];
+				uint64_t p1 = (uint64_t)PhiloxM1 * c2[l];
+				uint32_t n0 = (uint32_t)(p1>>32) ^ c1[l] ^ k0;
+				uint32_t n2 = (uint32_t)(p0>>32) ^ c3[l] ^ k1;
+				c1[l] = (uint32_t)p1;
+				c3[l] = (uint32_t)p0;
+				c0[l] = n0;
+				c2[l] = n2;
+			}
+			k0 += PhiloxW0;
+			k1 += PhiloxW1;
+		}
+		for (unsigned l=0; l<Lanes; ++l) {
+			out[i+2*l] = toUnit(c3[l], c2[l])*scale + min;
+			out[i+2*l+1] = toUnit(c1[l], c0[l])*scale + min;
+		}
+		counter[0] += Lanes;
+	}
+
+	// Remaining numbers one block at a time, matching the order above
+	buffered = 0;
+	for (; i<n; ++i)
+		out[i] = uniform()*scale + min;
+}
+
+/*****************************************************************
+ *
+ * 					randomBetween
+ *
+ *****************************************************************/
+
+void PAO::setRandomSeed( uint64_t seed )
+{
+	globalSeed = seed;
+}
+
+uint64_t PAO::getRandomSeed()
+{
+	return globalSeed;
+}
+
+double PAO::randomBetween( double min, double max )
+{
+	// Every thread gets a stream of its own, recreated if the seed changes
+	thread_local uint64_t streamSeed = 0;
+	thread_local uint64_t streamId = threadStreams++;
+	thread_local RandomStream stream(globalSeed, streamId, 0xFFFFFFFF);
+
+	uint64_t seed = globalSeed;
+	if (seed != streamSeed) {
+		stream = RandomStream(seed, streamId, 0xFFFFFFFF);
+		streamSeed = seed;
+	}
+	return stream.uniform(min, max);
+}
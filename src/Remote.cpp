@@ -0,0 +1,497 @@
+/*
+ * Remote.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <iostream>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+
+#include "Optimizer/Remote.h"
+
+
+#ifndef ERROR
+	/** Macro generates coloured output with file and line number */
+	#define WARN(TO_COUT)  {std::string strfile(__FILE__);\
+		strfile = strfile.substr(strfile.rfind('/')+1, std::string::npos);\
+		std::cout<<"\e[0;33mWarning: "<<strfile<<":"<<__LINE__<<" - "<<	TO_COUT << "\e[0m" << std::endl<<std::flush;}
+
+	#define ERROR(TO_COUT)  {std::string strfile(__FILE__);\
+		strfile = strfile.substr(strfile.rfind('/')+1, std::string::npos);\
+		std::cout<<"\e[0;31mERROR: "<<strfile<<":"<<__LINE__<<" - "<<	TO_COUT << "\e[0m" << std::endl<<std::flush;\
+		abort();}
+#endif
+
+
+namespace
+{
+	/** How often a worker sends a heartbeat */
+	const std::chrono::milliseconds HeartbeatInterval(1000);
+	/** How often the pool checks heartbeats */
+	const int AcceptPollMilliseconds = 200;
+
+	bool sendAll( int socket, const void* data, size_t size )
+	{
+		const char* p = (const char*)data;
+		while (size > 0) {
+			ssize_t sent = send(socket, p, size, MSG_NOSIGNAL);
+			if (sent < 0 && errno == EINTR)
+				continue;
+			if (sent <= 0)
+				return false;
+			p += sent;
+			size -= sent;
+		}
+		return true;
+	}
+
+	bool receiveAll( int socket, void* data, size_t size )
+	{
+		char* p = (char*)data;
+		while (size > 0) {
+			ssize_t received = recv(socket, p, size, 0);
+			if (received < 0 && errno == EINTR)
+				continue;
+			if (received <= 0)
+				return false;
+			p += received;
+			size -= received;
+		}
+		return true;
+	}
+
+	void setNoDelay( int socket )
+	{
+		int one = 1;
+		setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+
+	PAO::MessageHeader makeHeader( PAO::MessageType_t type, uint64_t batchId, uint32_t count, uint32_t dimensions )
+	{
+		PAO::MessageHeader header;
+		header.magic = PAO::MessageMagic;
+		header.type = type;
+		header.batchId = batchId;
+		header.count = count;
+		header.dimensions = dimensions;
+		return header;
+	}
+}
+
+/*****************************************************************
+ *
+ * 					Class RemoteWorkerPool
+ *
+ *****************************************************************/
+
+PAO::RemoteWorkerPool::RemoteWorkerPool( ParameterBounds bounds, unsigned short port )
+{
+	this->bounds = bounds;
+	messageSize = 16;
+	pipelineDepth = 4;
+	heartbeatTimeout = std::chrono::milliseconds(5000);
+	nextBatchId = 0;
+	resent = 0;
+	waitingReported = false;
+	stop = false;
+
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener < 0)
+		ERROR("socket: "<<strerror(errno));
+	int one = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0)
+		ERROR("bind to port "<<port<<": "<<strerror(errno));
+	if (listen(listener, 64) != 0)
+		ERROR("listen: "<<strerror(errno));
+
+	socklen_t length = sizeof(address);
+	getsockname(listener, (sockaddr*)&address, &length);
+	this->port = ntohs(address.sin_port);
+
+	acceptor = std::thread(&RemoteWorkerPool::acceptConnections, this);
+}
+
+PAO::RemoteWorkerPool::~RemoteWorkerPool()
+{
+	stop = true;
+	acceptor.join();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		MessageHeader header = makeHeader(ShutdownMessage, 0, 0, 0);
+		for (auto it=connections.begin(); it!=connections.end(); ++it) {
+			Connection* connection = it->get();
+			std::lock_guard<std::mutex> sendLock(connection->sendMutex);
+			sendAll(connection->socket, &header, sizeof(header));
+			shutdown(connection->socket, SHUT_RDWR);
+		}
+	}
+
+	for (auto it=connections.begin(); it!=connections.end(); ++it) {
+		(*it)->reader.join();
+		close((*it)->socket);
+	}
+	close(listener);
+}
+
+unsigned PAO::RemoteWorkerPool::getConnectionCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	unsigned count = 0;
+	for (auto it=connections.begin(); it!=connections.end(); ++it)
+		if ((*it)->ready)
+			++count;
+	return count;
+}
+
+void PAO::RemoteWorkerPool::evaluate( const double* candidates, unsigned count, double* fitness )
+{
+	const unsigned dims = bounds.size();
+	Request request;
+	request.remaining = 0;
+	request.sending = 0;
+
+	const unsigned batch = std::min<unsigned>(messageSize, MaxBatch);
+
+	std::vector<std::pair<Connection*,Task> > assigned;
+	std::unique_lock<std::mutex> lock(mutex);
+	for (unsigned first=0; first<count; first+=batch) {
+		Task task;
+		task.request = &request;
+		task.candidates = candidates + (size_t)first*dims;
+		task.fitness = fitness + first;
+		task.count = std::min(batch, count-first);
+		task.batchId = 0;
+		queue.push_back(task);
+		++request.remaining;
+	}
+
+	assignTasks(assigned);
+	if (assigned.empty() && !waitingReported) {
+		std::cout << "Waiting for remote workers on port "<<port<<std::endl;
+		waitingReported = true;
+	}
+	lock.unlock();
+	sendTasks(assigned);
+	lock.lock();
+
+	done.wait(lock, [&] {return request.remaining == 0 && request.sending == 0;});
+}
+
+void PAO::RemoteWorkerPool::assignTasks( std::vector<std::pair<Connection*,Task> > &assigned )
+{
+	while (!queue.empty()) {
+		// Least loaded connection with room left
+		Connection* best = 0;
+		for (auto it=connections.begin(); it!=connections.end(); ++it) {
+			Connection* connection = it->get();
+			if (connection->ready && connection->inFlight.size() < pipelineDepth &&
+					(best == 0 || connection->inFlight.size() < best->inFlight.size()))
+				best = connection;
+		}
+		if (best == 0)
+			return;
+
+		Task task = queue.front();
+		queue.pop_front();
+		task.batchId = nextBatchId++;
+		best->inFlight.push_back(task);
+		++best->sending;
+		++task.request->sending;
+		assigned.push_back(std::make_pair(best, task));
+	}
+}
+
+void PAO::RemoteWorkerPool::sendTasks( std::vector<std::pair<Connection*,Task> > &assigned )
+{
+	if (assigned.empty())
+		return;
+
+	const unsigned dims = bounds.size();
+	for (unsigned i=0; i<assigned.size(); ++i) {
+		Connection* connection = assigned[i].first;
+		const Task &task = assigned[i].second;
+		MessageHeader header = makeHeader(EvaluateMessage, task.batchId, task.count, dims);
+
+		std::lock_guard<std::mutex> sendLock(connection->sendMutex);
+		if (!sendAll(connection->socket, &header, sizeof(header)) ||
+				!sendAll(connection->socket, task.candidates, sizeof(double)*task.count*dims))
+			shutdown(connection->socket, SHUT_RDWR); // The reader requeues its tasks
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (unsigned i=0; i<assigned.size(); ++i) {
+			--assigned[i].first->sending;
+			--assigned[i].second.request->sending;
+		}
+	}
+	done.notify_all();
+	assigned.clear();
+}
+
+void PAO::RemoteWorkerPool::acceptConnections()
+{
+	while (!stop) {
+		pollfd request;
+		request.fd = listener;
+		request.events = POLLIN;
+		request.revents = 0;
+		if (poll(&request, 1, AcceptPollMilliseconds) > 0 && (request.revents & POLLIN)) {
+			sockaddr_in address;
+			socklen_t length = sizeof(address);
+			int socket = accept(listener, (sockaddr*)&address, &length);
+			if (socket >= 0) {
+				setNoDelay(socket);
+				Connection* connection = new Connection;
+				connection->socket = socket;
+				connection->peer = std::string(inet_ntoa(address.sin_addr)) + ":" + std::to_string(ntohs(address.sin_port));
+				connection->lastSeen = std::chrono::steady_clock::now();
+				connection->sending = 0;
+				connection->ready = false;
+				connection->dropped = false;
+				connection->finished = false;
+
+				std::lock_guard<std::mutex> lock(mutex);
+				connections.push_back(std::unique_ptr<Connection>(connection));
+				connection->reader = std::thread(&RemoteWorkerPool::readConnection, this, connection);
+			}
+		}
+
+		// Drop silent workers and clean up after lost ones
+		std::vector<std::unique_ptr<Connection> > finished;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto now = std::chrono::steady_clock::now();
+			for (auto it=connections.begin(); it!=connections.end(); ) {
+				Connection* connection = it->get();
+				if (!connection->dropped && !connection->finished && now - connection->lastSeen > heartbeatTimeout) {
+					WARN("No heartbeat from remote worker "<<connection->peer<<", dropping it");
+					connection->dropped = true;
+					shutdown(connection->socket, SHUT_RDWR);
+				}
+				if (connection->finished && connection->sending == 0) {
+					finished.push_back(std::move(*it));
+					it = connections.erase(it);
+				}
+				else
+					++it;
+			}
+		}
+		for (unsigned i=0; i<finished.size(); ++i) {
+			finished[i]->reader.join();
+			close(finished[i]->socket);
+		}
+	}
+}
+
+void PAO::RemoteWorkerPool::readConnection( Connection* connection )
+{
+	std::vector<std::pair<Connection*,Task> > assigned;
+	std::vector<double> values;
+	MessageHeader header;
+
+	if (!receiveAll(connection->socket, &header, sizeof(header)) || header.magic != MessageMagic ||
+			header.type != HelloMessage || (int)header.dimensions != bounds.size()) {
+		if (!stop)
+			WARN("Rejecting remote worker "<<connection->peer<<", expected "<<bounds.size()<<" dimensions");
+	}
+	else {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			std::cout << "Remote worker connected from "<<connection->peer<<std::endl;
+			connection->ready = true;
+			connection->lastSeen = std::chrono::steady_clock::now();
+			assignTasks(assigned);
+		}
+		sendTasks(assigned);
+
+		while (receiveAll(connection->socket, &header, sizeof(header)) && header.magic == MessageMagic) {
+			if (header.type == ResultMessage) {
+				// The count comes from the network, only trust it for a batch we sent
+				bool expected = false;
+				if (header.count <= MaxBatch) {
+					std::lock_guard<std::mutex> lock(mutex);
+					for (auto it=connection->inFlight.begin(); it!=connection->inFlight.end() && !expected; ++it)
+						expected = (it->batchId == header.batchId && it->count == header.count);
+				}
+				if (!expected) {
+					WARN("Dropping remote worker "<<connection->peer<<", unexpected result of "<<header.count<<" candidates");
+					break;
+				}
+				values.resize(header.count);
+				if (!receiveAll(connection->socket, values.data(), sizeof(double)*header.count))
+					break;
+			}
+			else if (header.type != HeartbeatMessage)
+				break;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				connection->lastSeen = std::chrono::steady_clock::now();
+				if (header.type == ResultMessage) {
+					for (auto it=connection->inFlight.begin(); it!=connection->inFlight.end(); ++it) {
+						if (it->batchId != header.batchId || it->count != header.count)
+							continue;
+						std::copy(values.begin(), values.end(), it->fitness);
+						--it->request->remaining;
+						connection->inFlight.erase(it);
+						break;
+					}
+					assignTasks(assigned);
+				}
+			}
+			if (header.type == ResultMessage) {
+				done.notify_all();
+				sendTasks(assigned);
+			}
+		}
+	}
+
+	// Connection lost, give its tasks to the others
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		connection->ready = false;
+		if (!connection->inFlight.empty() && !stop)
+			WARN("Lost remote worker "<<connection->peer<<", resending "<<connection->inFlight.size()<<" batches");
+		resent += connection->inFlight.size();
+		queue.insert(queue.begin(), connection->inFlight.begin(), connection->inFlight.end());
+		connection->inFlight.clear();
+		assignTasks(assigned);
+	}
+	sendTasks(assigned);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	connection->finished = true;
+}
+
+/*****************************************************************
+ *
+ * 					Class RemoteWorker
+ *
+ *****************************************************************/
+
+PAO::RemoteWorker::RemoteWorker( RemoteWorkerPool &pool, unsigned batchSize ) : pool(pool)
+{
+	setParameterBounds(pool.getParameterBounds());
+	setBatchSize(batchSize);
+}
+
+double PAO::RemoteWorker::fitnessFunction( Parameters &parameters )
+{
+	double fitness;
+	pool.evaluate(&parameters[0], 1, &fitness);
+	return fitness;
+}
+
+void PAO::RemoteWorker::fitnessFunctionBatch( const double* candidates, unsigned count,
+		unsigned dimensions, double* fitness )
+{
+	if ((int)dimensions != pool.getParameterBounds().size())
+		ERROR("RemoteWorkerPool has "<<pool.getParameterBounds().size()<<" dimensions, got "<<dimensions);
+	pool.evaluate(candidates, count, fitness);
+}
+
+/*****************************************************************
+ *
+ * 					runRemoteWorker
+ *
+ *****************************************************************/
+
+bool PAO::runRemoteWorker( OptimizationWorker &worker, const std::string &host, unsigned short port )
+{
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	int sock = -1;
+	bool reported = false;
+	while (sock < 0) {
+		addrinfo* addresses = 0;
+		if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) == 0) {
+			for (addrinfo* a=addresses; a!=0 && sock<0; a=a->ai_next) {
+				sock = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+				if (sock >= 0 && connect(sock, a->ai_addr, a->ai_addrlen) != 0) {
+					close(sock);
+					sock = -1;
+				}
+			}
+			freeaddrinfo(addresses);
+		}
+		if (sock < 0) {
+			if (!reported)
+				std::cout << "Waiting for master at "<<host<<":"<<port<<std::endl;
+			reported = true;
+			std::this_thread::sleep_for(HeartbeatInterval);
+		}
+	}
+	setNoDelay(sock);
+
+	const unsigned dims = worker.getParameterBounds().size();
+	std::mutex sendMutex;
+	MessageHeader header = makeHeader(HelloMessage, 0, 0, dims);
+	sendAll(sock, &header, sizeof(header));
+
+	// Heartbeats keep coming while a long batch is evaluated
+	std::mutex heartbeatMutex;
+	std::condition_variable heartbeatStop;
+	bool running = true;
+	std::thread heartbeat([&] {
+		MessageHeader beat = makeHeader(HeartbeatMessage, 0, 0, 0);
+		std::unique_lock<std::mutex> lock(heartbeatMutex);
+		while (!heartbeatStop.wait_for(lock, HeartbeatInterval, [&] {return !running;})) {
+			std::lock_guard<std::mutex> sendLock(sendMutex);
+			sendAll(sock, &beat, sizeof(beat));
+		}
+	});
+
+	bool shutdownReceived = false;
+	std::vector<double> candidates, fitness;
+	while (receiveAll(sock, &header, sizeof(header)) && header.magic == MessageMagic) {
+		if (header.type == ShutdownMessage) {
+			shutdownReceived = true;
+			break;
+		}
+		if (header.type != EvaluateMessage || header.dimensions != dims || header.count > MaxBatch)
+			break;
+
+		candidates.resize((size_t)header.count*dims);
+		fitness.resize(header.count);
+		if (!receiveAll(sock, candidates.data(), sizeof(double)*candidates.size()))
+			break;
+		worker.evaluate(candidates.data(), dims, header.count, dims, fitness.data());
+
+		MessageHeader result = makeHeader(ResultMessage, header.batchId, header.count, dims);
+		std::lock_guard<std::mutex> sendLock(sendMutex);
+		if (!sendAll(sock, &result, sizeof(result)) || !sendAll(sock, fitness.data(), sizeof(double)*fitness.size()))
+			break;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(heartbeatMutex);
+		running = false;
+	}
+	heartbeatStop.notify_all();
+	heartbeat.join();
+	close(sock);
+	return shutdownReceived;
+}
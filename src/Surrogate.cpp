@@ -0,0 +1,105 @@
+/*
+ * Surrogate.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "Optimizer/Optimizer.h"
+#include "Optimizer/Surrogate.h"
+
+
+const unsigned PAO::SurrogateModel::MaxNeighbors;
+
+PAO::SurrogateModel::SurrogateModel( ParameterBounds &bounds, unsigned neighbors, unsigned capacity )
+{
+	for (int i=0; i<bounds.size(); ++i) {
+		double range = bounds.max[i] - bounds.min[i];
+		origin.push_back( bounds.min[i] );
+		scale.push_back( range > 0 ? 1/range : 1 );
+	}
+	this->neighbors = std::max(1u, std::min(neighbors, MaxNeighbors));
+	this->capacity = std::max(this->neighbors, capacity);
+	points.resize((size_t)this->capacity*origin.size());
+	values.resize(this->capacity);
+	clear();
+}
+
+void PAO::SurrogateModel::add( const double* rows, unsigned stride, unsigned count, const double* fitness,
+		const unsigned char* lowerBounds )
+{
+	unsigned dims = dimensions();
+	for (unsigned i=0; i<count; ++i) {
+		if (!std::isfinite(fitness[i]) || fitness[i] == std::numeric_limits<double>::max())
+			continue;
+		if (lowerBounds != 0 && lowerBounds[i])
+			continue;
+
+		const double* x = rows + (size_t)i*stride;
+		double* p = &points[(size_t)next*dims];
+		for (unsigned j=0; j<dims; ++j)
+			p[j] = (x[j]-origin[j])*scale[j];
+		values[next] = fitness[i];
+
+		next = (next+1)%capacity;
+		this->count = std::min(this->count+1, capacity);
+	}
+}
+
+double PAO::SurrogateModel::predict( const double* x, double* scratch ) const
+{
+	if (count == 0)
+		return std::numeric_limits<double>::max();
+
+	unsigned dims = dimensions();
+	for (unsigned j=0; j<dims; ++j)
+		scratch[j] = (x[j]-origin[j])*scale[j];
+
+	// Nearest points so far, sorted by distance
+	double nearDistance[MaxNeighbors];
+	unsigned nearIndex[MaxNeighbors];
+	unsigned found = 0;
+	unsigned k = std::min(neighbors, count);
+
+	for (unsigned i=0; i<count; ++i) {
+		const double* p = &points[(size_t)i*dims];
+		double distance = 0;
+		for (unsigned j=0; j<dims; ++j) {
+			double d = p[j]-scratch[j];
+			distance += d*d;
+		}
+		if (found == k && distance >= nearDistance[k-1])
+			continue;
+
+		// Insert, dropping the farthest when all k are found
+		unsigned pos = (found < k) ? found++ : k-1;
+		while (pos > 0 && nearDistance[pos-1] > distance) {
+			nearDistance[pos] = nearDistance[pos-1];
+			nearIndex[pos] = nearIndex[pos-1];
+			--pos;
+		}
+		nearDistance[pos] = distance;
+		nearIndex[pos] = i;
+	}
+
+	// A point that was evaluated is predicted exactly
+	if (nearDistance[0] == 0)
+		return values[nearIndex[0]];
+
+	double sum = 0, weights = 0;
+	for (unsigned n=0; n<found; ++n) {
+		double weight = 1/nearDistance[n];
+		sum += weight*values[nearIndex[n]];
+		weights += weight;
+	}
+	return sum/weights;
+}
+
+void PAO::SurrogateModel::clear()
+{
+	count = 0;
+	next = 0;
+}
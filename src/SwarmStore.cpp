@@ -0,0 +1,176 @@
+/*
+ * SwarmStore.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define PAO_X86_KERNELS
+	#include <immintrin.h>
+#endif
+
+#include "Optimizer/SwarmStore.h"
+
+
+void PAO::SwarmStore::resize( unsigned particleCount, ParameterBounds &bounds )
+{
+	const unsigned lanes = ArrayAlignment/sizeof(double);
+
+	particles = particleCount;
+	dims = bounds.size();
+	rowStride = (dims + lanes-1)/lanes*lanes;
+
+	size_t elements = (size_t)particles*rowStride;
+	positions.resize(elements);
+	bests.resize(elements);
+	velocities.resize(elements);
+	fitnessValues.resize(particles);
+	bestFitnessValues.resize(particles);
+	lowerBounds.resize(rowStride);
+	upperBounds.resize(rowStride);
+
+	lowerBounds.fill(0);
+	upperBounds.fill(0);
+	for (unsigned j=0; j<dims; ++j) {
+		lowerBounds[j] = bounds.min[j];
+		upperBounds[j] = bounds.max[j];
+	}
+}
+
+void PAO::SwarmStore::clearPadding( unsigned i )
+{
+	for (unsigned j=dims; j<rowStride; ++j) {
+		position(i)[j] = 0;
+		best(i)[j] = 0;
+		velocity(i)[j] = 0;
+	}
+}
+
+/*****************************************************************
+ *
+ * 					Velocity kernels
+ *
+ *****************************************************************/
+
+static void velocityKernelScalar( double* x, double* v, const double* p, const double* l,
+		const double* r1, const double* r2, const double* lower, const double* upper,
+		unsigned n, double inertia, double c1, double c2 )
+{
+	for (unsigned j=0; j<n; ++j) {
+		v[j] = v[j]*inertia + c1*r1[j]*(p[j]-x[j]) + c2*r2[j]*(l[j]-x[j]);
+
+		double newPos = x[j] + v[j];
+		if (newPos < lower[j])
+			newPos = lower[j];
+		if (newPos > upper[j])
+			newPos = upper[j];
+		x[j] = newPos;
+	}
+}
+
+#ifdef PAO_X86_KERNELS
+
+__attribute__((target("avx2,fma")))
+static void velocityKernelAVX2( double* x, double* v, const double* p, const double* l,
+		const double* r1, const double* r2, const double* lower, const double* upper,
+		unsigned n, double inertia, double c1, double c2 )
+{
+	const __m256d w = _mm256_set1_pd(inertia);
+	const __m256d k1 = _mm256_set1_pd(c1);
+	const __m256d k2 = _mm256_set1_pd(c2);
+	unsigned j=0;
+	for (; j+4<=n; j+=4) {
+		__m256d xj = _mm256_loadu_pd(x+j);
+		__m256d dp = _mm256_sub_pd(_mm256_loadu_pd(p+j), xj);
+		__m256d dl = _mm256_sub_pd(_mm256_loadu_pd(l+j), xj);
+		__m256d vj = _mm256_mul_pd(_mm256_loadu_pd(v+j), w);
+		vj = _mm256_fmadd_pd(_mm256_mul_pd(k1, _mm256_loadu_pd(r1+j)), dp, vj);
+		vj = _mm256_fmadd_pd(_mm256_mul_pd(k2, _mm256_loadu_pd(r2+j)), dl, vj);
+		_mm256_storeu_pd(v+j, vj);
+
+		xj = _mm256_add_pd(xj, vj);
+		xj = _mm256_max_pd(xj, _mm256_loadu_pd(lower+j));
+		xj = _mm256_min_pd(xj, _mm256_loadu_pd(upper+j));
+		_mm256_storeu_pd(x+j, xj);
+	}
+	velocityKernelScalar(x+j, v+j, p+j, l+j, r1+j, r2+j, lower+j, upper+j, n-j, inertia, c1, c2);
+}
+
+__attribute__((target("avx512f")))
+static void velocityKernelAVX512( double* x, double* v, const double* p, const double* l,
+		const double* r1, const double* r2, const double* lower, const double* upper,
+		unsigned n, double inertia, double c1, double c2 )
+{
+	const __m512d w = _mm512_set1_pd(inertia);
+	const __m512d k1 = _mm512_set1_pd(c1);
+	const __m512d k2 = _mm512_set1_pd(c2);
+	unsigned j=0;
+	for (; j+8<=n; j+=8) {
+		__m512d xj = _mm512_loadu_pd(x+j);
+		__m512d dp = _mm512_sub_pd(_mm512_loadu_pd(p+j), xj);
+		__m512d dl = _mm512_sub_pd(_mm512_loadu_pd(l+j), xj);
+		__m512d vj = _mm512_mul_pd(_mm512_loadu_pd(v+j), w);
+		vj = _mm512_fmadd_pd(_mm512_mul_pd(k1, _mm512_loadu_pd(r1+j)), dp, vj);
+		vj = _mm512_fmadd_pd(_mm512_mul_pd(k2, _mm512_loadu_pd(r2+j)), dl, vj);
+		_mm512_storeu_pd(v+j, vj);
+
+		xj = _mm512_add_pd(xj, vj);
+		// Masked forms with all lanes set, the plain ones trip -Wmaybe-uninitialized in gcc 12
+		xj = _mm512_mask_max_pd(xj, 0xFF, xj, _mm512_loadu_pd(lower+j));
+		xj = _mm512_mask_min_pd(xj, 0xFF, xj, _mm512_loadu_pd(upper+j));
+		_mm512_storeu_pd(x+j, xj);
+	}
+	velocityKernelScalar(x+j, v+j, p+j, l+j, r1+j, r2+j, lower+j, upper+j, n-j, inertia, c1, c2);
+}
+
+#endif
+
+namespace
+{
+	struct KernelChoice
+	{
+		PAO::VelocityKernel kernel;
+		const char* name;
+	};
+
+	KernelChoice detectVelocityKernel()
+	{
+		KernelChoice choice = {velocityKernelScalar, "scalar"};
+#ifdef PAO_X86_KERNELS
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f")) {
+			choice.kernel = velocityKernelAVX512;
+			choice.name = "avx512";
+		}
+		else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+			choice.kernel = velocityKernelAVX2;
+			choice.name = "avx2";
+		}
+#endif
+		// Allow forcing the portable kernel, e.g. for comparing results
+		const char* env = getenv("PAO_SCALAR_KERNEL");
+		if (env != 0 && strcmp(env, "0") != 0) {
+			choice.kernel = velocityKernelScalar;
+			choice.name = "scalar";
+		}
+		return choice;
+	}
+
+	const KernelChoice& velocityKernelChoice()
+	{
+		static const KernelChoice choice = detectVelocityKernel();
+		return choice;
+	}
+}
+
+PAO::VelocityKernel PAO::getVelocityKernel()
+{
+	return velocityKernelChoice().kernel;
+}
+
+const char* PAO::getVelocityKernelName()
+{
+	return velocityKernelChoice().name;
+}
@@ -0,0 +1,92 @@
+/*
+ * WorkerCounters.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <cmath>
+
+#include "Optimizer/WorkerCounters.h"
+
+
+PAO::WorkerStatistics::WorkerStatistics()
+{
+	evaluations = 0;
+	chunks = 0;
+	steals = 0;
+	timeouts = 0;
+	speculations = 0;
+	cutoffs = 0;
+	evaluationSeconds = 0;
+	fetchSeconds = 0;
+	lockSeconds = 0;
+	idleSeconds = 0;
+	for (unsigned b=0; b<LatencyBuckets; ++b)
+		latencyHistogram[b] = 0;
+}
+
+PAO::WorkerStatistics& PAO::WorkerStatistics::operator+=( const WorkerStatistics &other )
+{
+	evaluations += other.evaluations;
+	chunks += other.chunks;
+	steals += other.steals;
+	timeouts += other.timeouts;
+	speculations += other.speculations;
+	cutoffs += other.cutoffs;
+	evaluationSeconds += other.evaluationSeconds;
+	fetchSeconds += other.fetchSeconds;
+	lockSeconds += other.lockSeconds;
+	idleSeconds += other.idleSeconds;
+	for (unsigned b=0; b<LatencyBuckets; ++b)
+		latencyHistogram[b] += other.latencyHistogram[b];
+	return *this;
+}
+
+double PAO::WorkerStatistics::latencyPercentile( double p ) const
+{
+	uint64_t total = 0;
+	for (unsigned b=0; b<LatencyBuckets; ++b)
+		total += latencyHistogram[b];
+	if (total == 0)
+		return 0;
+
+	uint64_t seen = 0;
+	for (unsigned b=0; b<LatencyBuckets; ++b) {
+		seen += latencyHistogram[b];
+		if (seen >= p*total)
+			return std::ldexp(1.0, b+1) * 1e-9;
+	}
+	return std::ldexp(1.0, LatencyBuckets) * 1e-9;
+}
+
+PAO::WorkerCounters::WorkerCounters()
+{
+	evaluations = 0;
+	chunks = 0;
+	steals = 0;
+	timeouts = 0;
+	speculations = 0;
+	cutoffs = 0;
+	evaluationNanoseconds = 0;
+	fetchNanoseconds = 0;
+	lockNanoseconds = 0;
+	idleNanoseconds = 0;
+	for (unsigned b=0; b<LatencyBuckets; ++b)
+		histogram[b] = 0;
+}
+
+void PAO::WorkerCounters::snapshot( WorkerStatistics &statistics ) const
+{
+	statistics.evaluations = evaluations.load(std::memory_order_relaxed);
+	statistics.chunks = chunks.load(std::memory_order_relaxed);
+	statistics.steals = steals.load(std::memory_order_relaxed);
+	statistics.timeouts = timeouts.load(std::memory_order_relaxed);
+	statistics.speculations = speculations.load(std::memory_order_relaxed);
+	statistics.cutoffs = cutoffs.load(std::memory_order_relaxed);
+	statistics.evaluationSeconds = evaluationNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+	statistics.fetchSeconds = fetchNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+	statistics.lockSeconds = lockNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+	statistics.idleSeconds = idleNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+	for (unsigned b=0; b<LatencyBuckets; ++b)
+		statistics.latencyHistogram[b] = histogram[b].load(std::memory_order_relaxed);
+}